@@ -1,6 +1,23 @@
+from .parallel import Parallel
+from .trig import TrigArena
+from .trig import TrigSymbol
+from .trig import TrigSymbolTable
+from .trig import TrigSieve
+from .trig import TrigCounters
 from .trig import TrigMonomial
 from .trig import TrigPolynomial
 from .trig_tensor import TrigTensor
+from .trig_sparse_tensor import TrigSparseTensor
+from .trig_intern import TrigInternedTensor
+from .trig_real import RealTrigPolynomial
+from .trig_real import RealTrigTensor
+from .trig_evaluator import TrigEvaluator
 from .gate import Gate
 from .gate import GateLibrary
 from .circuit import Circuit
+from .circuit_network import ContractionPlan
+from .circuit_network import CircuitNetwork
+from .binary_io import BinaryIO
+from .matrix_cache import MatrixCache
+from .profiler import Profiler
+from .profiler import ProfileRecord
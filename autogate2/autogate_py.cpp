@@ -1,7 +1,19 @@
+#include "parallel.hpp"
+#include "trig_arena.hpp"
+#include "trig_symbol.hpp"
 #include "trig.hpp"
 #include "trig_tensor.hpp"
+#include "trig_sparse_tensor.hpp"
+#include "trig_intern.hpp"
+#include "trig_real.hpp"
+#include "trig_evaluator.hpp"
 #include "gate.hpp"
 #include "circuit.hpp"
+#include "binary_io.hpp"
+#include "matrix_cache.hpp"
+#include "profiler.hpp"
+#include "circuit_network.hpp"
+#include <thread>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
@@ -25,19 +37,194 @@ py::dict py_circuit_gates(
   return d;
 }
 
+// The variables of monomial as (name, order), sorted by name
+std::vector<std::pair<std::string, int>> py_named_variables(
+  const TrigMonomial& monomial)
+{
+  std::vector<std::pair<std::string, int>> variables;
+  for (auto const& variable : monomial.variables()) {
+    variables.push_back(std::make_pair(variable.first.name(), variable.second));
+  }
+  std::sort(variables.begin(), variables.end());
+  return variables;
+}
+
+// Python context manager for TrigSieve::Scope. __enter__ opens the scope on
+// the calling thread, and __exit__ only closes it from that thread while it is
+// the innermost open scope, so that the thread's current() never points at a
+// closed scope; npruned keeps the count of the block after it exits. A scope
+// collected while it cannot be closed safely is leaked instead.
+struct PyTrigSieveScope {
+  double cutoff;
+  size_t npruned;
+  std::unique_ptr<TrigSieve::Scope> scope;
+  std::thread::id owner;
+
+  PyTrigSieveScope(double cutoff) : cutoff(cutoff), npruned(0) {}
+
+  bool closable() const { return owner == std::this_thread::get_id() && TrigSieve::current() == scope.get(); }
+
+  ~PyTrigSieveScope() { if (scope && !closable()) scope.release(); }
+};
+
+// Read-only NumPy view of vector, which must live as long as owner
+template <typename T>
+py::array_t<T> py_vector_view(
+  const std::vector<T>& vector,
+  py::handle owner)
+{
+  py::array_t<T> array(std::vector<size_t>{vector.size()}, vector.data(), owner);
+  array.attr("setflags")("write"_a=false);
+  return array;
+}
+
+py::array_t<int32_t> py_trig_evaluator_exponents(
+  const TrigEvaluator& evaluator)
+{
+  std::vector<int32_t>* exponents = new std::vector<int32_t>(evaluator.exponents());
+  py::capsule owner(exponents, [](void* p) { delete static_cast<std::vector<int32_t>*>(p); });
+  return py::array_t<int32_t>(std::vector<size_t>{evaluator.nmonomial(), evaluator.symbols().size()}, exponents->data(), owner);
+}
+
+py::array_t<std::complex<double>> py_trig_evaluator_evaluate(
+  const TrigEvaluator& evaluator,
+  const std::vector<double>& angles)
+{
+  if (angles.size() != evaluator.symbols().size()) throw std::runtime_error("angles.size() != symbols.size()");
+  py::array_t<std::complex<double>> values(evaluator.shape());
+  std::vector<std::complex<double>> scratch(evaluator.scratch_size());
+  evaluator.evaluate(angles.data(), values.mutable_data(), scratch.data());
+  return values;
+}
+
+py::tuple py_trig_evaluator_evaluate_gradient(
+  const TrigEvaluator& evaluator,
+  const std::vector<double>& angles)
+{
+  if (angles.size() != evaluator.symbols().size()) throw std::runtime_error("angles.size() != symbols.size()");
+  std::vector<size_t> shape = {evaluator.symbols().size()};
+  shape.insert(shape.end(), evaluator.shape().begin(), evaluator.shape().end());
+  py::array_t<std::complex<double>> values(evaluator.shape());
+  py::array_t<std::complex<double>> gradients(shape);
+  std::vector<std::complex<double>> scratch(evaluator.scratch_size());
+  evaluator.evaluate_gradient(angles.data(), values.mutable_data(), gradients.mutable_data(), scratch.data());
+  return py::make_tuple(values, gradients);
+}
+
+py::array_t<std::complex<double>> py_trig_evaluator_evaluate_batch(
+  const TrigEvaluator& evaluator,
+  const py::array_t<double, py::array::c_style | py::array::forcecast>& angles)
+{
+  if (angles.ndim() != 2 || (size_t) angles.shape(1) != evaluator.symbols().size()) throw std::runtime_error("angles is not shape (nbatch, len(symbols))");
+  size_t nbatch = angles.shape(0);
+  std::vector<size_t> shape = {nbatch};
+  shape.insert(shape.end(), evaluator.shape().begin(), evaluator.shape().end());
+  py::array_t<std::complex<double>> values(shape);
+  const double* angles_data = angles.data();
+  std::complex<double>* values_data = values.mutable_data();
+  {
+    py::gil_scoped_release release;
+    evaluator.evaluate_batch(angles_data, nbatch, values_data);
+  }
+  return values;
+}
+
 PYBIND11_MODULE(autogate_plugin, m) {
 
+py::class_<Parallel>(m, "Parallel")
+.def_static("num_threads", &Parallel::num_threads)
+.def_static("set_num_threads", &Parallel::set_num_threads, "nthread"_a)
+;
+
+py::class_<TrigArena>(m, "TrigArena")
+.def_static("total_size", &TrigArena::total_size)
+.def_static("peak_size", &TrigArena::peak_size)
+.def_static("reset_peak_size", &TrigArena::reset_peak_size)
+;
+
+py::class_<TrigSieve> trig_sieve(m, "TrigSieve");
+trig_sieve
+.def_static("cutoff", &TrigSieve::cutoff)
+;
+
+py::class_<PyTrigSieveScope>(trig_sieve, "Scope")
+.def(py::init([](double cutoff) {
+  if (cutoff < 0.0) throw std::runtime_error("cutoff must be >= 0");
+  return new PyTrigSieveScope(cutoff);
+}), "cutoff"_a)
+.def_property_readonly("cutoff", [](const PyTrigSieveScope& scope) { return scope.cutoff; })
+.def_property_readonly("npruned", [](const PyTrigSieveScope& scope) { return scope.scope ? scope.scope->npruned() : scope.npruned; })
+.def("__enter__", [](py::object self) {
+  PyTrigSieveScope& scope = self.cast<PyTrigSieveScope&>();
+  if (scope.scope) throw std::runtime_error("TrigSieve.Scope is already open");
+  scope.scope.reset(new TrigSieve::Scope(scope.cutoff));
+  scope.owner = std::this_thread::get_id();
+  return self;
+})
+.def("__exit__", [](PyTrigSieveScope& scope, py::args) {
+  if (!scope.scope) return;
+  if (scope.owner != std::this_thread::get_id()) throw std::runtime_error("TrigSieve.Scope must be exited on the thread that entered it");
+  if (TrigSieve::current() != scope.scope.get()) throw std::runtime_error("TrigSieve.Scope must be exited before the scopes entered after it");
+  scope.npruned = scope.scope->npruned();
+  scope.scope.reset();
+})
+;
+
+py::class_<TrigCounters>(m, "TrigCounters")
+.def_static("nproduct", &TrigCounters::nproduct)
+.def_static("nmultiply", &TrigCounters::nmultiply)
+.def_static("nentry", &TrigCounters::nentry)
+.def_static("nterm", &TrigCounters::nterm)
+.def_static("max_entry_terms", &TrigCounters::max_entry_terms)
+.def_static("reset", &TrigCounters::reset)
+;
+
+py::class_<TrigSymbol>(m, "TrigSymbol")
+.def(py::init<const std::string&>(), "name"_a)
+.def(py::init<int>(), "name"_a)
+.def_static("from_id", &TrigSymbol::from_id, "id"_a)
+.def_property("id", &TrigSymbol::id, nullptr)
+.def_property("name", &TrigSymbol::name, nullptr)
+.def("__str__", &TrigSymbol::name)
+.def("__repr__", [](const TrigSymbol& symbol){return "TrigSymbol('" + symbol.name() + "')";})
+// Symbols compare, order and hash like their names, so that they can be
+// looked up with plain strings (e.g. in dicts keyed by TrigMonomial.variables
+// symbols) and sort the same way in every process
+.def("__hash__", [](const TrigSymbol& symbol){return py::hash(py::str(symbol.name()));})
+.def(py::self == py::self)
+.def(py::self != py::self)
+.def("__eq__", [](const TrigSymbol& symbol, const std::string& name){return symbol.name() == name;}, py::is_operator())
+.def("__ne__", [](const TrigSymbol& symbol, const std::string& name){return symbol.name() != name;}, py::is_operator())
+.def("__lt__", [](const TrigSymbol& a, const TrigSymbol& b){return a.name() < b.name();}, py::is_operator())
+;
+py::implicitly_convertible<py::str, TrigSymbol>();
+py::implicitly_convertible<py::int_, TrigSymbol>();
+
+py::class_<TrigSymbolTable>(m, "TrigSymbolTable")
+.def_static("id", &TrigSymbolTable::id, "name"_a)
+.def_static("name", &TrigSymbolTable::name, "id"_a)
+.def_static("size", &TrigSymbolTable::size)
+;
+
+// variables are listed in symbol id order, which for multi-character names is
+// their registration order in this process. Monomials order by their variables
+// sorted by name, matching TrigSymbol, so sorted() agrees across processes.
 py::class_<TrigMonomial>(m, "TrigMonomial")
-.def(py::init<const std::vector<std::pair<char, int>>&>(), "variables"_a)
+.def(py::init<const std::vector<std::pair<TrigSymbol, int>>&>(), "variables"_a)
 .def_property("variables", &TrigMonomial::variables, nullptr)
 .def_static("one", &TrigMonomial::one)
 .def("conj", &TrigMonomial::conj)
 .def(py::self * py::self)
+.def(py::self == py::self)
+.def(py::self != py::self)
+.def("__lt__", [](const TrigMonomial& a, const TrigMonomial& b){return py_named_variables(a) < py_named_variables(b);}, py::is_operator())
+.def("__hash__", &TrigMonomial::hash)
 ;
 
 py::class_<TrigPolynomial>(m, "TrigPolynomial")
 .def(py::init<const std::map<TrigMonomial, std::complex<double>>&>(), "polynomial"_a)
 .def_property("polynomial", &TrigPolynomial::polynomial, nullptr)
+.def_property("terms", &TrigPolynomial::terms, nullptr)
 .def_static("zero", &TrigPolynomial::zero)
 .def_static("one", &TrigPolynomial::one)
 .def(+py::self)
@@ -58,6 +245,7 @@ py::class_<TrigPolynomial>(m, "TrigPolynomial")
 .def(std::complex<double>() - py::self)
 .def("conj", &TrigPolynomial::conj)
 .def("sieved", &TrigPolynomial::sieved, "cutoff"_a=1.0E-12)
+.def("derivative", &TrigPolynomial::derivative, "symbol"_a)
 .def_static("equivalent_keys", &TrigPolynomial::equivalent_keys, "a"_a, "b"_a)
 .def_static("equivalent_values", &TrigPolynomial::equivalent_values, "a"_a, "b"_a, "cutoff"_a=1.0E-12)
 .def_static("equivalent", &TrigPolynomial::equivalent, "a"_a, "b"_a, "cutoff"_a=1.0E-12)
@@ -70,6 +258,12 @@ py::class_<TrigTensor>(m, "TrigTensor")
 .def_property("shape", &TrigTensor::shape, nullptr)
 .def_property("size", &TrigTensor::size, nullptr)
 .def_property("data", [](TrigTensor& a){return a.data();}, nullptr)
+.def("__len__", &TrigTensor::size)
+.def("__getitem__", [](const TrigTensor& a, size_t index){if (index >= a.size()) throw py::index_error(); return a.data()[index];}, "index"_a)
+.def("__getitem__", [](const TrigTensor& a, const std::vector<size_t>& indices){return a.data()[a.offset(indices)];}, "indices"_a)
+.def("__setitem__", [](TrigTensor& a, size_t index, const TrigPolynomial& value){if (index >= a.size()) throw py::index_error(); a.data()[index] = value;}, "index"_a, "value"_a)
+.def("__setitem__", [](TrigTensor& a, const std::vector<size_t>& indices, const TrigPolynomial& value){a.data()[a.offset(indices)] = value;}, "indices"_a, "value"_a)
+.def("flat", [](const TrigTensor& a, const std::vector<TrigSymbol>& symbols){return TrigEvaluator(a, symbols);}, "symbols"_a, py::call_guard<py::gil_scoped_release>())
 .def(+py::self)
 .def(-py::self)
 .def(py::self += py::self)
@@ -86,7 +280,123 @@ py::class_<TrigTensor>(m, "TrigTensor")
 .def(py::self -= std::complex<double>())
 .def(py::self - std::complex<double>())
 .def(std::complex<double>() - py::self)
-.def_static("gemm", &TrigTensor::gemm, "a"_a, "b"_a)
+.def("derivative", &TrigTensor::derivative, "symbol"_a)
+.def("jacobian", &TrigTensor::jacobian, "symbols"_a)
+.def("hessian", &TrigTensor::hessian, "symbols"_a)
+.def_static("gemm", &TrigTensor::gemm, "a"_a, "b"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("gemm", static_cast<TrigTensor (*)(const TrigSparseTensor&, const TrigTensor&)>(&TrigSparseTensor::gemm), "a"_a, "b"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("gemm", static_cast<TrigTensor (*)(const TrigTensor&, const TrigSparseTensor&)>(&TrigSparseTensor::gemm), "a"_a, "b"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("gemm", static_cast<TrigSparseTensor (*)(const TrigSparseTensor&, const TrigSparseTensor&)>(&TrigSparseTensor::gemm), "a"_a, "b"_a, py::call_guard<py::gil_scoped_release>())
+;
+
+py::class_<TrigSparseTensor>(m, "TrigSparseTensor")
+.def(py::init<const std::vector<size_t>&>(), "shape"_a)
+.def_property("shape", &TrigSparseTensor::shape, nullptr)
+.def_property("nnz", &TrigSparseTensor::nnz, nullptr)
+.def_property("row_offsets", &TrigSparseTensor::row_offsets, nullptr)
+.def_property("col_indices", &TrigSparseTensor::col_indices, nullptr)
+.def_property("data", &TrigSparseTensor::data, nullptr)
+.def_static("from_dense", &TrigSparseTensor::from_dense, "dense"_a)
+.def("dense", &TrigSparseTensor::dense)
+.def("transpose", &TrigSparseTensor::transpose)
+.def_static("gemm", static_cast<TrigTensor (*)(const TrigSparseTensor&, const TrigTensor&)>(&TrigSparseTensor::gemm), "a"_a, "b"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("gemm", static_cast<TrigTensor (*)(const TrigTensor&, const TrigSparseTensor&)>(&TrigSparseTensor::gemm), "a"_a, "b"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("gemm", static_cast<TrigSparseTensor (*)(const TrigSparseTensor&, const TrigSparseTensor&)>(&TrigSparseTensor::gemm), "a"_a, "b"_a, py::call_guard<py::gil_scoped_release>())
+;
+
+py::class_<RealTrigPolynomial>(m, "RealTrigPolynomial")
+.def_property("factors", &RealTrigPolynomial::factors, nullptr)
+.def_static("zero", &RealTrigPolynomial::zero)
+.def_static("one", &RealTrigPolynomial::one)
+.def(-py::self)
+.def(py::self + py::self)
+.def(py::self - py::self)
+.def(py::self * py::self)
+.def(py::self * double())
+.def(double() * py::self)
+.def_static("is_real", &RealTrigPolynomial::is_real, "poly"_a, "cutoff"_a=1.0E-12)
+.def_static("from_complex", &RealTrigPolynomial::from_complex, "poly"_a, "cutoff"_a=1.0E-12)
+.def("complex", &RealTrigPolynomial::complex)
+.def_static("cos", &RealTrigPolynomial::cos, "symbol"_a)
+.def_static("sin", &RealTrigPolynomial::sin, "symbol"_a)
+;
+
+py::class_<RealTrigTensor>(m, "RealTrigTensor")
+.def(py::init<const std::vector<size_t>&>(), "shape"_a)
+.def_property("shape", &RealTrigTensor::shape, nullptr)
+.def_property("size", &RealTrigTensor::size, nullptr)
+.def_property("data", [](RealTrigTensor& a){return a.data();}, nullptr)
+.def_static("is_real", &RealTrigTensor::is_real, "tensor"_a, "cutoff"_a=1.0E-12)
+.def_static("from_complex", &RealTrigTensor::from_complex, "tensor"_a, "cutoff"_a=1.0E-12)
+.def("complex", &RealTrigTensor::complex)
+;
+
+py::class_<TrigInternedTensor>(m, "TrigInternedTensor")
+.def_property("shape", &TrigInternedTensor::shape, nullptr)
+.def_property("handles", &TrigInternedTensor::handles, nullptr)
+.def_property("nunique", &TrigInternedTensor::nunique, nullptr)
+.def_static("from_dense", static_cast<TrigInternedTensor (*)(const TrigTensor&, double)>(&TrigInternedTensor::from_dense), "dense"_a, "cutoff"_a=1.0E-12)
+.def("dense", &TrigInternedTensor::dense)
+.def_static("gemm", &TrigInternedTensor::gemm, "a"_a, "b"_a, "max_memo_terms"_a=(size_t) TrigInternedTensor::default_max_memo_terms, py::call_guard<py::gil_scoped_release>())
+;
+
+py::class_<TrigEvaluator>(m, "TrigEvaluator")
+.def(py::init<const TrigTensor&, const std::vector<TrigSymbol>&>(), "tensor"_a, "symbols"_a)
+.def_property("shape", &TrigEvaluator::shape, nullptr)
+.def_property("symbols", &TrigEvaluator::symbols, nullptr)
+.def_property("size", &TrigEvaluator::size, nullptr)
+.def_property("nterm", &TrigEvaluator::nterm, nullptr)
+.def_property("nmonomial", &TrigEvaluator::nmonomial, nullptr)
+.def_property("entry_offsets", [](py::object self){return py_vector_view(self.cast<const TrigEvaluator&>().entry_offsets(), self);}, nullptr)
+.def_property("coefficients", [](py::object self){return py_vector_view(self.cast<const TrigEvaluator&>().coefficients(), self);}, nullptr)
+.def_property("term_monomials", [](py::object self){return py_vector_view(self.cast<const TrigEvaluator&>().term_monomials(), self);}, nullptr)
+.def_property("monomial_offsets", [](py::object self){return py_vector_view(self.cast<const TrigEvaluator&>().monomial_offsets(), self);}, nullptr)
+.def_property("variable_symbols", [](py::object self){return py_vector_view(self.cast<const TrigEvaluator&>().variable_symbols(), self);}, nullptr)
+.def_property("variable_orders", [](py::object self){return py_vector_view(self.cast<const TrigEvaluator&>().variable_orders(), self);}, nullptr)
+.def_property("exponents", py_trig_evaluator_exponents, nullptr)
+.def("evaluate", py_trig_evaluator_evaluate, "angles"_a)
+.def("evaluate_batch", py_trig_evaluator_evaluate_batch, "angles"_a)
+.def("evaluate_gradient", py_trig_evaluator_evaluate_gradient, "angles"_a)
+.def("tensor", &TrigEvaluator::tensor)
+.def_static("symbols_of", &TrigEvaluator::symbols_of, "tensor"_a)
+;
+
+py::class_<BinaryIO>(m, "BinaryIO")
+.def_static("save", static_cast<void (*)(const TrigTensor&, const std::string&)>(&BinaryIO::save), "tensor"_a, "path"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("save", static_cast<void (*)(const TrigEvaluator&, const std::string&)>(&BinaryIO::save), "evaluator"_a, "path"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("load", &BinaryIO::load, "path"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("load_evaluator", &BinaryIO::load_evaluator, "path"_a, py::call_guard<py::gil_scoped_release>())
+;
+
+py::class_<MatrixCache>(m, "MatrixCache")
+.def_static("directory", &MatrixCache::directory)
+.def_static("set_directory", &MatrixCache::set_directory, "directory"_a)
+.def_static("enabled", &MatrixCache::enabled)
+.def_static("hits", &MatrixCache::hits)
+.def_static("misses", &MatrixCache::misses)
+.def_static("store_failures", &MatrixCache::store_failures)
+.def_static("reset_counters", &MatrixCache::reset_counters)
+;
+
+py::class_<ProfileRecord>(m, "ProfileRecord")
+.def_readonly("kind", &ProfileRecord::kind)
+.def_readonly("time", &ProfileRecord::time)
+.def_readonly("qubits", &ProfileRecord::qubits)
+.def_readonly("ascii_symbols", &ProfileRecord::ascii_symbols)
+.def_readonly("seconds", &ProfileRecord::seconds)
+.def_readonly("nproduct", &ProfileRecord::nproduct)
+.def_readonly("nmultiply", &ProfileRecord::nmultiply)
+.def_readonly("nterm", &ProfileRecord::nterm)
+.def_readonly("nentry", &ProfileRecord::nentry)
+.def_readonly("max_entry_terms", &ProfileRecord::max_entry_terms)
+.def_readonly("mean_entry_terms", &ProfileRecord::mean_entry_terms)
+;
+
+py::class_<Profiler>(m, "Profiler")
+.def_static("enabled", &Profiler::enabled)
+.def_static("set_enabled", &Profiler::set_enabled, "enabled"_a)
+.def_static("records", &Profiler::records)
+.def_static("clear", &Profiler::clear)
 ;
 
 py::class_<Gate>(m, "Gate")
@@ -94,6 +404,8 @@ py::class_<Gate>(m, "Gate")
 .def_property("nqubit", &Gate::nqubit, nullptr)
 .def_property("matrix", &Gate::matrix, nullptr)
 .def_property("ascii_symbols", &Gate::ascii_symbols, nullptr)
+.def("conserves_weight", &Gate::conserves_weight)
+.def("real", &Gate::real)
 ;
 
 py::class_<GateLibrary>(m, "GateLibrary")
@@ -126,7 +438,45 @@ py::class_<Circuit>(m, "Circuit")
 .def_property("nqubit", &Circuit::nqubit, nullptr)
 .def_property("ntime", &Circuit::ntime, nullptr)
 .def("add_gate", &Circuit::add_gate, "time"_a, "qubits"_a, "gate"_a)
-.def("matrix", &Circuit::matrix)
+.def("remove_gate", &Circuit::remove_gate, "time"_a, "qubits"_a)
+.def("replace_gate", &Circuit::replace_gate, "time"_a, "qubits"_a, "gate"_a)
+.def_property("incremental", &Circuit::incremental, nullptr)
+.def("set_incremental", &Circuit::set_incremental, "incremental"_a)
+.def("hash", &Circuit::hash)
+.def("matrix_key", &Circuit::matrix_key)
+.def("matrix", static_cast<TrigTensor (Circuit::*)(const std::string&) const>(&Circuit::matrix), "ordering"_a="fold", py::call_guard<py::gil_scoped_release>())
+.def("save", &Circuit::save, "path"_a, py::call_guard<py::gil_scoped_release>())
+.def_static("load", &Circuit::load, "path"_a, py::call_guard<py::gil_scoped_release>())
+.def("sparse_matrix", &Circuit::sparse_matrix, py::call_guard<py::gil_scoped_release>())
+.def("real", &Circuit::real)
+.def("real_matrix", &Circuit::real_matrix, py::call_guard<py::gil_scoped_release>())
+.def("conserves_weight", &Circuit::conserves_weight)
+.def_static("sector_states", &Circuit::sector_states, "nqubit"_a, "weight"_a)
+.def("sector_matrix", &Circuit::sector_matrix, "weight"_a, py::call_guard<py::gil_scoped_release>())
+.def("block_matrix", &Circuit::block_matrix, py::call_guard<py::gil_scoped_release>())
+.def("fused", &Circuit::fused, "max_nqubit"_a=2, py::call_guard<py::gil_scoped_release>())
+.def("apply", &Circuit::apply, "state"_a, py::call_guard<py::gil_scoped_release>())
+.def("statevector", static_cast<TrigTensor (Circuit::*)(const std::string&) const>(&Circuit::statevector), "bitstring"_a, py::call_guard<py::gil_scoped_release>())
+.def("statevector", static_cast<TrigTensor (Circuit::*)(size_t) const>(&Circuit::statevector), "index"_a, py::call_guard<py::gil_scoped_release>())
+;
+
+py::class_<ContractionPlan>(m, "ContractionPlan")
+.def_readonly("ntensor", &ContractionPlan::ntensor)
+.def_readonly("steps", &ContractionPlan::steps)
+.def_readonly("nproduct", &ContractionPlan::nproduct)
+.def_readonly("max_entries", &ContractionPlan::max_entries)
+.def_readonly("nleg", &ContractionPlan::nleg)
+;
+
+py::class_<CircuitNetwork>(m, "CircuitNetwork")
+.def(py::init<const Circuit&>(), "circuit"_a)
+.def_property("nqubit", &CircuitNetwork::nqubit, nullptr)
+.def_property("ntensor", &CircuitNetwork::ntensor, nullptr)
+.def_property("max_entries", &CircuitNetwork::max_entries, nullptr)
+.def("set_max_entries", &CircuitNetwork::set_max_entries, "max_entries"_a)
+.def("plan", &CircuitNetwork::plan, "open_qubits"_a=std::vector<size_t>())
+.def("amplitude", &CircuitNetwork::amplitude, "x"_a, "y"_a, py::call_guard<py::gil_scoped_release>())
+.def("block", &CircuitNetwork::block, "open_qubits"_a, "x"_a, "y"_a, py::call_guard<py::gil_scoped_release>())
 ;
 
 }
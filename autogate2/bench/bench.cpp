@@ -0,0 +1,331 @@
+// Standalone autogate benchmark (make bench). Sweeps qubit count, circuit
+// depth, gate mix and number of distinct symbols, and prints one JSON object
+// per case on stdout:
+//
+//   {"kind": "matrix", "nqubit": 4, "depth": 2, "mix": "ry_cx", "nsymbol": 4,
+//    "repeat": 3, "seconds": ..., "nproduct": ..., "nmultiply": ...,
+//    "nterm": ..., "max_entry_terms": ..., "peak_entry_terms": ...,
+//    "peak_rss_kb": ...}
+//
+// seconds is the best of repeat runs, the counters are TrigCounters for one
+// run, nterm and max_entry_terms describe the result, peak_entry_terms is the
+// largest entry emitted by any product during the run (intermediates
+// included), and peak_rss_kb is the peak RSS of the case. Each case runs in a
+// forked child so that its peak RSS is not inherited from earlier, larger
+// cases.
+//
+// Usage: autogate_bench [--kind monomial,poly,gemm,matrix] [--nqubit 2,3,4]
+//   [--depth 1,2,3] [--mix ry_cx,ry_cz,givens,cry_h] [--nsymbol 1,2,4]
+//   [--repeat 3] [--threads 0]
+
+#include "../circuit.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace autogate;
+
+namespace {
+
+struct Case {
+    std::string kind;
+    size_t nqubit;
+    size_t depth;
+    std::string mix;
+    size_t nsymbol;
+    size_t repeat;
+};
+
+struct Result {
+    double seconds;
+    size_t nproduct;
+    size_t nmultiply;
+    size_t nterm;
+    size_t max_entry_terms;
+    size_t peak_entry_terms;
+};
+
+std::vector<std::string> split(const std::string& text)
+{
+    std::vector<std::string> fields;
+    std::stringstream stream(text);
+    std::string field;
+    while (std::getline(stream, field, ',')) {
+        if (!field.empty()) fields.push_back(field);
+    }
+    return fields;
+}
+
+std::vector<size_t> split_sizes(const std::string& text)
+{
+    std::vector<size_t> values;
+    for (auto const& field : split(text)) {
+        values.push_back(std::stoul(field));
+    }
+    return values;
+}
+
+TrigSymbol symbol(size_t index) { return TrigSymbol("s" + std::to_string(index)); }
+
+// Brickwork circuit: each of depth steps is a layer of one-qubit gates on every
+// qubit followed by two-qubit gates on alternating neighbour pairs. The gate
+// using a parameter takes symbol (gate index % nsymbol).
+Circuit brickwork(size_t nqubit, size_t depth, const std::string& mix, size_t nsymbol)
+{
+    Circuit circuit;
+    size_t time = 0;
+    size_t ngate = 0;
+    auto next_symbol = [&]() { return symbol(ngate++ % nsymbol); };
+    for (size_t step = 0; step < depth; step++) {
+        for (size_t qubit = 0; qubit < nqubit; qubit++) {
+            if (mix == "ry_cx" || mix == "ry_cz") {
+                circuit.add_gate(time, {qubit}, GateLibrary::Ry(next_symbol()));
+            } else if (mix == "givens") {
+                if (step == 0 && qubit % 2 == 0) circuit.add_gate(time, {qubit}, GateLibrary::X());
+            } else if (mix == "cry_h") {
+                circuit.add_gate(time, {qubit}, GateLibrary::H());
+            } else {
+                throw std::runtime_error("Unknown gate mix " + mix);
+            }
+        }
+        time++;
+        for (size_t qubit = step % 2; qubit + 1 < nqubit; qubit += 2) {
+            std::vector<size_t> qubits = {qubit, qubit + 1};
+            if (mix == "ry_cx") {
+                circuit.add_gate(time, qubits, GateLibrary::cX());
+            } else if (mix == "ry_cz") {
+                circuit.add_gate(time, qubits, GateLibrary::cZ());
+            } else if (mix == "givens") {
+                circuit.add_gate(time, qubits, GateLibrary::G(next_symbol()));
+            } else {
+                circuit.add_gate(time, qubits, GateLibrary::cRy(next_symbol()));
+            }
+        }
+        time++;
+    }
+    return circuit;
+}
+
+// cos(s0) + sin(s1) + ... over nsymbol symbols, raised to the power depth
+TrigPolynomial polynomial(size_t nsymbol, size_t depth)
+{
+    TrigPolynomial sum = TrigPolynomial::zero();
+    for (size_t index = 0; index < nsymbol; index++) {
+        sum = sum + (index % 2 ? TrigPolynomial::sin(symbol(index)) : TrigPolynomial::cos(symbol(index)));
+    }
+    TrigPolynomial power = sum;
+    for (size_t step = 1; step < depth; step++) {
+        power = power * sum;
+    }
+    return power;
+}
+
+void describe(const TrigTensor& tensor, Result& result)
+{
+    result.nterm = 0;
+    result.max_entry_terms = 0;
+    for (auto const& poly : tensor.data()) {
+        result.nterm += poly.terms().size();
+        result.max_entry_terms = std::max(result.max_entry_terms, poly.terms().size());
+    }
+}
+
+template <typename Function>
+double best_seconds(size_t repeat, Function function)
+{
+    double best = 0.0;
+    for (size_t run = 0; run < repeat; run++) {
+        TrigCounters::reset();
+        auto start = std::chrono::steady_clock::now();
+        function();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (run == 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+Result run(const Case& bench)
+{
+    Result result = {0.0, 0, 0, 0, 0, 0};
+    if (bench.kind == "monomial") {
+        // 2^depth * 1000 products of two monomials over nsymbol symbols
+        std::vector<std::pair<TrigSymbol, int>> avariables, bvariables;
+        for (size_t index = 0; index < bench.nsymbol; index++) {
+            avariables.push_back(std::make_pair(symbol(index), 1));
+            bvariables.push_back(std::make_pair(symbol(index), index % 2 ? 1 : -1));
+        }
+        std::sort(avariables.begin(), avariables.end());
+        std::sort(bvariables.begin(), bvariables.end());
+        TrigMonomial a(avariables), b(bvariables);
+        size_t count = 1000ULL << bench.depth;
+        volatile size_t sink = 0;
+        result.seconds = best_seconds(bench.repeat, [&]() {
+            for (size_t index = 0; index < count; index++) {
+                sink = sink + (a * b).size();
+            }
+        });
+        result.nproduct = count;
+        result.nmultiply = count;
+        result.nterm = result.max_entry_terms = result.peak_entry_terms = 1;
+        return result;
+    }
+    if (bench.kind == "poly") {
+        TrigPolynomial product;
+        result.seconds = best_seconds(bench.repeat, [&]() { product = polynomial(bench.nsymbol, bench.depth); });
+        result.nterm = result.max_entry_terms = product.terms().size();
+    } else if (bench.kind == "gemm") {
+        Circuit circuit = brickwork(bench.nqubit, bench.depth, bench.mix, bench.nsymbol);
+        TrigTensor a = circuit.matrix();
+        TrigTensor product;
+        result.seconds = best_seconds(bench.repeat, [&]() { product = TrigTensor::gemm(a, a); });
+        describe(product, result);
+    } else if (bench.kind == "matrix") {
+        Circuit circuit = brickwork(bench.nqubit, bench.depth, bench.mix, bench.nsymbol);
+        TrigTensor matrix;
+        result.seconds = best_seconds(bench.repeat, [&]() { matrix = circuit.matrix(); });
+        describe(matrix, result);
+    } else {
+        throw std::runtime_error("Unknown benchmark kind " + bench.kind);
+    }
+    result.nproduct = TrigCounters::nproduct();
+    result.nmultiply = TrigCounters::nmultiply();
+    result.peak_entry_terms = std::max(result.max_entry_terms, TrigCounters::max_entry_terms());
+    return result;
+}
+
+// text as a quoted JSON string
+std::string json_string(const std::string& text)
+{
+    std::ostringstream quoted;
+    quoted << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted << '\\' << c;
+        } else if ((unsigned char) c < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", (unsigned) c);
+            quoted << escape;
+        } else {
+            quoted << c;
+        }
+    }
+    quoted << '"';
+    return quoted.str();
+}
+
+std::string json(const Case& bench, const Result& result, long peak_rss_kb)
+{
+    std::ostringstream line;
+    line.precision(9);
+    line << "{\"kind\": " << json_string(bench.kind)
+         << ", \"nqubit\": " << bench.nqubit
+         << ", \"depth\": " << bench.depth
+         << ", \"mix\": " << json_string(bench.mix)
+         << ", \"nsymbol\": " << bench.nsymbol
+         << ", \"repeat\": " << bench.repeat
+         << ", \"nthread\": " << Parallel::num_threads()
+         << ", \"seconds\": " << result.seconds
+         << ", \"nproduct\": " << result.nproduct
+         << ", \"nmultiply\": " << result.nmultiply
+         << ", \"nterm\": " << result.nterm
+         << ", \"max_entry_terms\": " << result.max_entry_terms
+         << ", \"peak_entry_terms\": " << result.peak_entry_terms
+         << ", \"peak_rss_kb\": " << peak_rss_kb << "}";
+    return line.str();
+}
+
+std::string json_error(const Case& bench, const std::string& error)
+{
+    std::ostringstream line;
+    line << "{\"kind\": " << json_string(bench.kind)
+         << ", \"nqubit\": " << bench.nqubit
+         << ", \"depth\": " << bench.depth
+         << ", \"mix\": " << json_string(bench.mix)
+         << ", \"nsymbol\": " << bench.nsymbol
+         << ", \"error\": " << json_string(error) << "}";
+    return line.str();
+}
+
+// Runs one case in a child process and prints its line
+void run_isolated(const Case& bench)
+{
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) throw std::runtime_error("fork failed");
+    if (pid == 0) {
+        int status = 0;
+        try {
+            Result result = run(bench);
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            std::cout << json(bench, result, usage.ru_maxrss) << std::endl;
+        } catch (std::exception& e) {
+            std::cout << json_error(bench, e.what()) << std::endl;
+            status = 1;
+        }
+        std::_Exit(status);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (WIFSIGNALED(status)) {
+        std::cout << json_error(bench, "killed by signal " + std::to_string(WTERMSIG(status))) << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> kinds = {"monomial", "poly", "gemm", "matrix"};
+    std::vector<size_t> nqubits = {2, 3, 4};
+    std::vector<size_t> depths = {1, 2, 3};
+    std::vector<std::string> mixes = {"ry_cx", "ry_cz", "givens", "cry_h"};
+    std::vector<size_t> nsymbols = {1, 2, 4};
+    size_t repeat = 3;
+
+    try {
+        for (int arg = 1; arg < argc; arg++) {
+            std::string option = argv[arg];
+            if (arg + 1 >= argc) throw std::runtime_error("Missing value for " + option);
+            std::string value = argv[++arg];
+            if (option == "--kind") kinds = split(value);
+            else if (option == "--nqubit") nqubits = split_sizes(value);
+            else if (option == "--depth") depths = split_sizes(value);
+            else if (option == "--mix") mixes = split(value);
+            else if (option == "--nsymbol") nsymbols = split_sizes(value);
+            else if (option == "--repeat") repeat = std::stoul(value);
+            else if (option == "--threads") Parallel::set_num_threads(std::stoi(value));
+            else throw std::runtime_error("Unknown option " + option);
+        }
+        if (repeat == 0) throw std::runtime_error("--repeat must be >= 1");
+        for (auto nsymbol : nsymbols) {
+            if (nsymbol == 0) throw std::runtime_error("--nsymbol must be >= 1");
+        }
+    } catch (std::exception& e) {
+        std::cerr << "autogate_bench: " << e.what() << std::endl;
+        return 2;
+    }
+
+    // monomial and poly cases do not depend on the circuit, so they only sweep
+    // depth and nsymbol
+    for (auto const& kind : kinds) {
+        bool circuit = kind == "gemm" || kind == "matrix";
+        for (auto nqubit : circuit ? nqubits : std::vector<size_t>{0}) {
+            for (auto depth : depths) {
+                for (auto const& mix : circuit ? mixes : std::vector<std::string>{""}) {
+                    for (auto nsymbol : nsymbols) {
+                        run_isolated(Case{kind, nqubit, depth, mix, nsymbol, repeat});
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
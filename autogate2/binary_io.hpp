@@ -0,0 +1,315 @@
+#pragma once
+
+#include "trig_evaluator.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace autogate {
+
+// Versioned binary files for TrigTensor and (through Circuit::save and
+// Circuit::load) Circuit. A tensor is stored in the flat TrigEvaluator layout,
+// so loading is a bounds-checked bulk copy of each array out of an mmap of the
+// file, with no per-term parsing.
+//
+// Every file starts with a 32-byte header: the magic "AUTOGATE", a byte order
+// mark (0x01020304), the format version, the kind (tensor or circuit), and a
+// reserved word. All sections are 8-byte aligned and in native byte order. A
+// tensor section is:
+//
+//   uint64 ndim, nsymbol, nentry, nterm, nmonomial, nvariable
+//   uint64 shape[ndim]
+//   uint64 nname_bytes
+//   char   names[nname_bytes]       (NUL-terminated symbol names)
+//   uint64 entry_offsets[nentry+1]
+//   complex<double> coefficients[nterm]
+//   uint64 term_monomials[nterm]
+//   uint64 monomial_offsets[nmonomial+1]
+//   uint32 variable_symbols[nvariable]
+//   int32  variable_orders[nvariable]
+//
+// A circuit is a uint64 gate count followed, per gate in circuit order, by
+// uint64 time, nqubit, qubits[nqubit], nname_bytes, the NUL-terminated ASCII
+// symbols, and a tensor section holding the gate matrix.
+class BinaryIO {
+
+public:
+
+static const uint32_t version = 1;
+static const uint32_t kind_tensor = 1;
+static const uint32_t kind_circuit = 2;
+
+static void save(const TrigTensor& tensor, const std::string& path)
+{
+    save(TrigEvaluator(tensor, TrigEvaluator::symbols_of(tensor)), path);
+}
+
+static void save(const TrigEvaluator& evaluator, const std::string& path)
+{
+    Writer writer(path);
+    writer.header(kind_tensor);
+    writer.tensor(evaluator);
+    writer.close();
+}
+
+static TrigEvaluator load_evaluator(const std::string& path)
+{
+    Mapping mapping(path);
+    Reader reader(mapping.data(), mapping.size());
+    reader.header(kind_tensor);
+    TrigEvaluator evaluator = reader.tensor();
+    reader.finish();
+    return evaluator;
+}
+
+static TrigTensor load(const std::string& path)
+{
+    return load_evaluator(path).tensor();
+}
+
+static const uint32_t byte_order = 0x01020304;
+
+// Read-only mmap of a whole file
+class Mapping {
+public:
+Mapping(const std::string& path) : data_(nullptr), size_(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) { ::close(fd); throw std::runtime_error("Cannot stat " + path); }
+    size_ = st.st_size;
+    if (size_) {
+        void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) { ::close(fd); throw std::runtime_error("Cannot mmap " + path); }
+        data_ = static_cast<const char*>(data);
+    }
+    ::close(fd);
+}
+~Mapping() { if (data_) ::munmap(const_cast<char*>(data_), size_); }
+Mapping(const Mapping&) = delete;
+Mapping& operator=(const Mapping&) = delete;
+const char* data() const { return data_; }
+size_t size() const { return size_; }
+private:
+const char* data_;
+size_t size_;
+};
+
+class Writer {
+public:
+Writer(const std::string& path) : path_(path), stream_(path, std::ios::binary | std::ios::trunc), size_(0)
+{
+    if (!stream_) throw std::runtime_error("Cannot open " + path);
+}
+
+void close()
+{
+    stream_.close();
+    if (!stream_) throw std::runtime_error("Cannot write " + path_);
+}
+
+void header(uint32_t kind)
+{
+    bytes("AUTOGATE", 8);
+    value<uint32_t>(byte_order);
+    value<uint32_t>(version);
+    value<uint32_t>(kind);
+    value<uint32_t>(0);
+    value<uint64_t>(0);
+}
+
+template <typename T>
+void value(T value) { bytes(&value, sizeof(T)); }
+
+template <typename T>
+void array(const std::vector<T>& values)
+{
+    bytes(values.data(), values.size() * sizeof(T));
+    pad();
+}
+
+void names(const std::vector<std::string>& names)
+{
+    std::string buffer;
+    for (auto const& name : names) {
+        buffer += name;
+        buffer += '\0';
+    }
+    value<uint64_t>(buffer.size());
+    bytes(buffer.data(), buffer.size());
+    pad();
+}
+
+void tensor(const TrigEvaluator& evaluator)
+{
+    std::vector<std::string> symbol_names;
+    for (auto const& symbol : evaluator.symbols()) {
+        symbol_names.push_back(symbol.name());
+    }
+    value<uint64_t>(evaluator.shape().size());
+    value<uint64_t>(evaluator.symbols().size());
+    value<uint64_t>(evaluator.size());
+    value<uint64_t>(evaluator.nterm());
+    value<uint64_t>(evaluator.nmonomial());
+    value<uint64_t>(evaluator.variable_symbols().size());
+    array(std::vector<uint64_t>(evaluator.shape().begin(), evaluator.shape().end()));
+    names(symbol_names);
+    array(evaluator.entry_offsets());
+    array(evaluator.coefficients());
+    array(evaluator.term_monomials());
+    array(evaluator.monomial_offsets());
+    array(evaluator.variable_symbols());
+    array(evaluator.variable_orders());
+}
+
+private:
+std::string path_;
+std::ofstream stream_;
+size_t size_;
+
+void bytes(const void* data, size_t size)
+{
+    stream_.write(static_cast<const char*>(data), size);
+    size_ += size;
+}
+
+void pad()
+{
+    static const char zeros[8] = {0};
+    bytes(zeros, (8 - size_ % 8) % 8);
+}
+};
+
+class Reader {
+public:
+Reader(const char* data, size_t size) : data_(data), size_(size), offset_(0) {}
+
+void header(uint32_t kind)
+{
+    if (size_ < 32 || std::memcmp(data_, "AUTOGATE", 8) != 0) throw std::runtime_error("Not an autogate binary file");
+    offset_ = 8;
+    if (value<uint32_t>() != byte_order) throw std::runtime_error("File byte order does not match this machine");
+    if (value<uint32_t>() != version) throw std::runtime_error("Unsupported autogate binary file version");
+    if (value<uint32_t>() != kind) throw std::runtime_error("Wrong kind of autogate binary file");
+    value<uint32_t>();
+    value<uint64_t>();
+}
+
+void finish()
+{
+    if (offset_ != size_) throw std::runtime_error("Trailing data in autogate binary file");
+}
+
+template <typename T>
+T value()
+{
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template <typename T>
+std::vector<T> array(uint64_t count)
+{
+    if (count > size_ / sizeof(T)) throw std::runtime_error("Truncated autogate binary file");
+    if (count == 0) return std::vector<T>();
+    const char* data = take(count * sizeof(T));
+    std::vector<T> values(count);
+    std::memcpy(values.data(), data, count * sizeof(T));
+    skip_pad();
+    return values;
+}
+
+std::vector<std::string> names(uint64_t count)
+{
+    uint64_t nbyte = value<uint64_t>();
+    const char* data = take(nbyte);
+    std::vector<std::string> names;
+    for (const char* name = data; name < data + nbyte; name += names.back().size() + 1) {
+        names.push_back(std::string(name, strnlen(name, data + nbyte - name)));
+    }
+    if (names.size() != count) throw std::runtime_error("Corrupt names in autogate binary file");
+    skip_pad();
+    return names;
+}
+
+TrigEvaluator tensor()
+{
+    uint64_t ndim = value<uint64_t>();
+    uint64_t nsymbol = value<uint64_t>();
+    uint64_t nentry = value<uint64_t>();
+    uint64_t nterm = value<uint64_t>();
+    uint64_t nmonomial = value<uint64_t>();
+    uint64_t nvariable = value<uint64_t>();
+    std::vector<uint64_t> shape = array<uint64_t>(ndim);
+    std::vector<TrigSymbol> symbols;
+    for (auto const& name : names(nsymbol)) {
+        symbols.push_back(TrigSymbol(name));
+    }
+    if (nentry == ~((uint64_t) 0) || nmonomial == ~((uint64_t) 0)) throw std::runtime_error("Corrupt autogate binary file");
+    std::vector<uint64_t> entry_offsets = array<uint64_t>(nentry + 1);
+    std::vector<std::complex<double>> coefficients = array<std::complex<double>>(nterm);
+    std::vector<uint64_t> term_monomials = array<uint64_t>(nterm);
+    std::vector<uint64_t> monomial_offsets = array<uint64_t>(nmonomial + 1);
+    std::vector<uint32_t> variable_symbols = array<uint32_t>(nvariable);
+    std::vector<int32_t> variable_orders = array<int32_t>(nvariable);
+    check_monomials(nsymbol, monomial_offsets, variable_symbols, variable_orders);
+    return TrigEvaluator(
+        std::vector<size_t>(shape.begin(), shape.end()),
+        symbols,
+        std::move(entry_offsets),
+        std::move(coefficients),
+        std::move(term_monomials),
+        std::move(monomial_offsets),
+        std::move(variable_symbols),
+        std::move(variable_orders));
+}
+
+private:
+const char* data_;
+size_t size_;
+size_t offset_;
+
+const char* take(size_t size)
+{
+    if (size > size_ - offset_) throw std::runtime_error("Truncated autogate binary file");
+    const char* data = data_ + offset_;
+    offset_ += size;
+    return data;
+}
+
+void skip_pad() { take((8 - offset_ % 8) % 8); }
+
+// Each monomial must hold distinct symbols with nonzero orders that TrigMonomial
+// can negate; TrigEvaluator::tensor packs them into words without checking
+static void check_monomials(
+    uint64_t nsymbol,
+    const std::vector<uint64_t>& monomial_offsets,
+    const std::vector<uint32_t>& variable_symbols,
+    const std::vector<int32_t>& variable_orders)
+{
+    for (size_t monomial = 0; monomial + 1 < monomial_offsets.size(); monomial++) {
+        uint64_t begin = monomial_offsets[monomial];
+        uint64_t end = monomial_offsets[monomial + 1];
+        if (begin > end || end > variable_symbols.size()) throw std::runtime_error("Corrupt autogate binary file");
+        for (uint64_t variable = begin; variable < end; variable++) {
+            int32_t order = variable_orders[variable];
+            if (variable_symbols[variable] >= nsymbol || order == 0 || order == INT32_MIN) throw std::runtime_error("Corrupt autogate binary file");
+            for (uint64_t other = begin; other < variable; other++) {
+                if (variable_symbols[other] == variable_symbols[variable]) throw std::runtime_error("Corrupt autogate binary file");
+            }
+        }
+    }
+}
+};
+
+};
+
+} // namespace autogate
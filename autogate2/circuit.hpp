@@ -1,6 +1,11 @@
 #pragma once
 
 #include "gate.hpp"
+#include "trig_sparse_tensor.hpp"
+#include "parallel.hpp"
+#include "matrix_cache.hpp"
+#include "profiler.hpp"
+#include <mutex>
 #include <set>
 
 namespace autogate { 
@@ -11,7 +16,9 @@ class Circuit {
 
 public:
 
-Circuit() {}
+typedef std::map<circuit_key_t, Gate>::const_iterator gate_iterator;
+
+Circuit() : incremental_(false) {}
 
 const std::map<circuit_key_t, Gate>& gates() const { return gates_; }
 const std::set<size_t> qubits() const { return qubits_; }
@@ -45,66 +52,880 @@ void add_gate(
     }
 
     gates_[std::pair<size_t, std::vector<size_t>>(time, qubits)] = gate; 
+    invalidate(time);
+}
+
+void remove_gate(
+    size_t time,
+    const std::vector<size_t>& qubits)
+{
+    auto gate = gates_.find(circuit_key_t(time, qubits));
+    if (gate == gates_.end()) throw std::runtime_error("No gate at these time and qubit indices");
+    gates_.erase(gate);
+
+    for (auto qubit : qubits) {
+        times_and_qubits_.erase(std::pair<size_t, size_t>(time, qubit));
+    }
+    if (gates_.lower_bound(circuit_key_t(time, std::vector<size_t>())) == gates_.lower_bound(circuit_key_t(time + 1, std::vector<size_t>()))) {
+        times_.erase(time);
+    }
+    qubits_.clear();
+    for (auto const& time_and_qubit : times_and_qubits_) {
+        qubits_.insert(time_and_qubit.second);
+    }
+    invalidate(time);
+}
+
+void replace_gate(
+    size_t time,
+    const std::vector<size_t>& qubits,
+    const Gate& gate)
+{
+    remove_gate(time, qubits);
+    add_gate(time, qubits, gate);
+}
+
+// Incremental mode keeps, for every time index t, the product of the slices
+// at times <= t. add_gate, remove_gate and replace_gate at time t drop the
+// products from t on, and matrix() resumes from the last surviving product, so
+// an edit at time t only re-applies the slices from t to the end. This holds
+// ntime dense unitaries in memory. Concurrent matrix() calls on one circuit in
+// this mode are safe but take turns; editing the circuit while matrix() runs is
+// not.
+bool incremental() const { return incremental_; }
+
+void set_incremental(bool incremental)
+{
+    incremental_ = incremental;
+    std::lock_guard<std::mutex> lock(prefixes_.mutex);
+    prefixes_.products.clear();
+}
+
+// A term with its variables as (symbol name, order), sorted by name
+typedef std::pair<std::vector<std::pair<std::string, int>>, std::complex<double>> named_term_t;
+
+// Canonical hash of the gates: placement, ASCII symbols, and every matrix entry
+// (symbol names, orders and coefficient bits), as 32 hex digits. Monomials and
+// terms are hashed in symbol name order rather than symbol id order, so
+// structurally identical circuits hash equally in any process, whatever order
+// the process registered its symbols in.
+std::string hash() const
+{
+    Hasher hasher;
+    hasher.add((uint64_t) gates_.size());
+    for (auto const& gate : gates_) {
+        hasher.add((uint64_t) gate.first.first);
+        hasher.add((uint64_t) gate.first.second.size());
+        for (auto qubit : gate.first.second) {
+            hasher.add((uint64_t) qubit);
+        }
+        for (auto const& ascii_symbol : gate.second.ascii_symbols()) {
+            hasher.add(ascii_symbol);
+        }
+        for (auto const& poly : gate.second.matrix().data()) {
+            hasher.add((uint64_t) poly.terms().size());
+            std::vector<named_term_t> terms;
+            for (auto const& term : poly.terms()) {
+                std::vector<std::pair<std::string, int>> variables;
+                for (const TrigMonomial::word_t* word = term.first.begin(); word != term.first.end(); ++word) {
+                    variables.push_back(std::make_pair(TrigSymbolTable::name(TrigMonomial::symbol(*word)), TrigMonomial::order(*word)));
+                }
+                std::sort(variables.begin(), variables.end());
+                terms.push_back(std::make_pair(std::move(variables), term.second));
+            }
+            std::sort(terms.begin(), terms.end(), [](const named_term_t& a, const named_term_t& b) { return a.first < b.first; });
+            for (auto const& term : terms) {
+                hasher.add((uint64_t) term.first.size());
+                for (auto const& variable : term.first) {
+                    hasher.add(variable.first);
+                    hasher.add((uint64_t) (uint32_t) variable.second);
+                }
+                hasher.add(term.second.real());
+                hasher.add(term.second.imag());
+            }
+        }
+    }
+    return hasher.hex();
+}
+
+// MatrixCache key of matrix(): hash() together with the file format version and
+// the TrigSieve cutoff, which both change the stored result
+std::string matrix_key() const
+{
+    Hasher hasher;
+    hasher.add(std::string("matrix"));
+    hasher.add(hash());
+    hasher.add((uint64_t) BinaryIO::version);
+    hasher.add(TrigSieve::cutoff());
+    return hasher.hex();
 }
 
+// The circuit unitary. If a MatrixCache directory is set, the cache is consulted
+// before any symbolic work and the result is stored there on a miss; a failed
+// store is counted by MatrixCache and does not affect the result.
 TrigTensor matrix() const
 {
-    uint32_t nqubit = qubits_.size();
-    size_t dim = 1ULL<<nqubit;
-    std::vector<size_t> shape = {dim, dim};
-    TrigTensor mat(shape);
+    return matrix("fold");
+}
+
+// The circuit unitary, with the time slices combined in the given order:
+//   "fold"   - apply every slice in turn to the identity (the default, and the
+//              only ordering that uses incremental mode)
+//   "tree"   - build each slice's operator and multiply neighbours pairwise
+//              in a balanced binary tree, running the products of each level
+//              concurrently
+//   "greedy" - build each slice's operator and repeatedly multiply the
+//              neighbouring pair whose gemm does the fewest term multiplies
+// The orderings give the same unitary up to roundoff. Which is fastest depends
+// on how quickly the polynomials grow: "fold" only ever multiplies gate entries
+// into the accumulated matrix, while the others also multiply two accumulated
+// products together.
+TrigTensor matrix(const std::string& ordering) const
+{
+    if (ordering != "fold" && ordering != "tree" && ordering != "greedy") throw std::runtime_error("Unknown ordering " + ordering);
+
+    std::string key;
+    if (MatrixCache::enabled()) {
+        key = matrix_key();
+        TrigTensor cached;
+        if (MatrixCache::load(key, cached)) return cached;
+    }
+
+    TrigArena::Scope arena_scope;
+    TrigTensor mat;
+    if (ordering == "tree") {
+        mat = tree_matrix();
+    } else if (ordering == "greedy") {
+        mat = greedy_matrix();
+    } else if (incremental_) {
+        mat = incremental_matrix();
+    } else {
+        mat = identity(1ULL<<nqubit());
+        apply_layers(mat, [](const TrigTensor* gate_op) { return gate_op; });
+    }
+    if (!key.empty()) MatrixCache::store(key, mat);
+    return mat;
+}
+
+// Writes the circuit in the BinaryIO circuit format: a uint64 gate count followed,
+// per gate in circuit order, by uint64 time, nqubit, qubits[nqubit], nname_bytes,
+// the NUL-terminated ASCII symbols, and a tensor section holding the gate matrix
+void save(const std::string& path) const
+{
+    BinaryIO::Writer writer(path);
+    writer.header(BinaryIO::kind_circuit);
+    writer.value<uint64_t>(gates_.size());
+    for (auto const& gate : gates_) {
+        const std::vector<size_t>& qubits = gate.first.second;
+        writer.value<uint64_t>(gate.first.first);
+        writer.value<uint64_t>(qubits.size());
+        writer.array(std::vector<uint64_t>(qubits.begin(), qubits.end()));
+        writer.names(gate.second.ascii_symbols());
+        const TrigTensor& matrix = gate.second.matrix();
+        writer.tensor(TrigEvaluator(matrix, TrigEvaluator::symbols_of(matrix)));
+    }
+    writer.close();
+}
+
+static Circuit load(const std::string& path)
+{
+    BinaryIO::Mapping mapping(path);
+    BinaryIO::Reader reader(mapping.data(), mapping.size());
+    reader.header(BinaryIO::kind_circuit);
+    Circuit circuit;
+    uint64_t ngate = reader.value<uint64_t>();
+    for (uint64_t index = 0; index < ngate; index++) {
+        uint64_t time = reader.value<uint64_t>();
+        uint64_t nqubit = reader.value<uint64_t>();
+        std::vector<uint64_t> qubits = reader.array<uint64_t>(nqubit);
+        std::vector<std::string> ascii_symbols = reader.names(nqubit);
+        TrigTensor matrix = reader.tensor().tensor();
+        circuit.add_gate(time, std::vector<size_t>(qubits.begin(), qubits.end()), Gate(nqubit, matrix, ascii_symbols));
+    }
+    reader.finish();
+    return circuit;
+}
+
+// U applied to state, whose leading dimension is 2^nqubit (any further
+// dimensions are carried along as independent columns)
+TrigTensor apply(const TrigTensor& state) const
+{
+    if (state.shape().empty() || state.shape()[0] != (1ULL<<nqubit())) throw std::runtime_error("state leading dimension != 2**nqubit");
+
+    TrigArena::Scope arena_scope;
+    TrigTensor state2 = state;
+    apply_layers(state2, [](const TrigTensor* gate_op) { return gate_op; });
+    return state2;
+}
+
+// U|index>, propagating only a 2^nqubit vector rather than the full unitary
+TrigTensor statevector(size_t index) const
+{
+    size_t dim = 1ULL<<nqubit();
+    if (index >= dim) throw std::runtime_error("index >= 2**nqubit");
+    TrigTensor state(std::vector<size_t>{dim});
+    state.data()[index] = TrigPolynomial::one();
+    return apply(state);
+}
+
+// U|bitstring>, with bitstring in qiskit ordering (the last character is qubit 0)
+TrigTensor statevector(const std::string& bitstring) const
+{
+    if (bitstring.size() != nqubit()) throw std::runtime_error("bitstring.size() != nqubit");
+    size_t index = 0;
+    for (size_t qubit = 0; qubit < bitstring.size(); qubit++) {
+        char bit = bitstring[bitstring.size() - 1 - qubit];
+        if (bit != '0' && bit != '1') throw std::runtime_error("bitstring must contain only 0 and 1");
+        if (bit == '1') index |= 1ULL<<qubit;
+    }
+    return statevector(index);
+}
+
+// The circuit unitary in CSR form, built one column at a time so that only
+// the structurally nonzero entries of the unitary are ever held at once
+TrigSparseTensor sparse_matrix() const
+{
+    TrigArena::Scope arena_scope;
+    size_t dim = 1ULL<<nqubit();
+
+    // Columns of the unitary are accumulated as rows of its transpose
+    std::vector<size_t> row_offsets = {0};
+    std::vector<size_t> col_indices;
+    std::vector<TrigPolynomial> data;
+    for (size_t col = 0; col < dim; col++) {
+        TrigTensor state = statevector(col);
+        for (size_t row = 0; row < dim; row++) {
+            if (state.data()[row].terms().empty()) continue;
+            col_indices.push_back(row);
+            data.push_back(std::move(state.data()[row]));
+        }
+        row_offsets.push_back(data.size());
+    }
+    return TrigSparseTensor({dim, dim}, row_offsets, col_indices, std::move(data)).transpose();
+}
+
+// True if every gate conserves Hamming weight, so that the unitary is block
+// diagonal across the nqubit+1 weight sectors
+bool conserves_weight() const
+{
+    for (auto const& gate : gates_) {
+        if (!gate.second.conserves_weight()) return false;
+    }
+    return true;
+}
+
+// True if every gate is real, so that real_matrix applies
+bool real() const
+{
+    for (auto const& gate : gates_) {
+        if (!gate.second.real()) return false;
+    }
+    return true;
+}
+
+// The unitary in the real cos/sin basis, built with real coefficients
+// throughout. Only available when every gate is real.
+RealTrigTensor real_matrix() const
+{
+    if (!real()) throw std::runtime_error("Circuit is not real");
+
+    TrigArena::Scope arena_scope;
+    std::map<const TrigTensor*, RealTrigTensor> real_ops;
+    for (auto const& gate : gates_) {
+        real_ops[&gate.second.matrix()] = RealTrigTensor::from_complex(gate.second.matrix());
+    }
+
+    size_t dim = 1ULL<<nqubit();
+    RealTrigTensor mat(std::vector<size_t>{dim, dim});
+    for (size_t index = 0; index < dim; index++) {
+        mat.data()[index*dim + index] = RealTrigPolynomial::one();
+    }
+
+    apply_layers(mat, [&real_ops](const TrigTensor* gate_op) { return &real_ops[gate_op]; });
+    return mat;
+}
+
+// The basis state indices of Hamming weight weight among 2^nqubit, in
+// increasing order. These index the rows and columns of sector_matrix(weight).
+static std::vector<size_t> sector_states(size_t nqubit, size_t weight)
+{
+    std::vector<size_t> states;
+    for (size_t state = 0; state < (1ULL<<nqubit); state++) {
+        if ((size_t) __builtin_popcountll(state) == weight) states.push_back(state);
+    }
+    return states;
+}
+
+// The C(n,weight) x C(n,weight) block of the unitary within the weight sector,
+// built without forming any entries outside the sector
+TrigTensor sector_matrix(size_t weight) const
+{
+    if (!conserves_weight()) throw std::runtime_error("Circuit does not conserve Hamming weight");
+    if (weight > nqubit()) throw std::runtime_error("weight > nqubit");
+
+    TrigArena::Scope arena_scope;
+    std::vector<size_t> states = sector_states(nqubit(), weight);
+    size_t dim = states.size();
+    TrigTensor mat(std::vector<size_t>{dim, dim});
     for (size_t index = 0; index < dim; index++) {
         mat.data()[index*dim + index] = TrigPolynomial::one();
     }
 
     for (auto const& gate : gates_) {
-        uint32_t qubits = gate.first.second.size();
-        TrigTensor mat2(shape);
+        apply_sector_gate(mat, states, gate.first.second, gate.second.matrix());
+    }
+    return mat;
+}
 
-        TrigTensor gate_op = gate.second.matrix();
-        size_t gate_dim = gate_op.shape()[0];
+// [sector_matrix(weight) for weight in 0..nqubit]
+std::vector<TrigTensor> block_matrix() const
+{
+    if (!conserves_weight()) throw std::runtime_error("Circuit does not conserve Hamming weight");
 
-        std::vector<size_t> oubits;
-        for (size_t index = 0; index < nqubit; index++) {
-            if (std::find(gate.first.second.begin(), gate.first.second.end(), index) == gate.first.second.end()) {
-                oubits.push_back(index);
-            }
+    std::vector<TrigTensor> blocks;
+    for (size_t weight = 0; weight <= nqubit(); weight++) {
+        blocks.push_back(sector_matrix(weight));
+    }
+    return blocks;
+}
+
+// Left-multiplies tensor, whose rows are the basis states states of a single
+// weight sector, in place by the weight-conserving gate_op acting on qubits.
+// Rows which differ only in the gate qubits are grouped as in apply_gate, but
+// each group only holds the gate-local indices of the sector's local weight.
+static void apply_sector_gate(
+    TrigTensor& tensor,
+    const std::vector<size_t>& states,
+    const std::vector<size_t>& qubits,
+    const TrigTensor& gate_op)
+{
+    size_t dim = tensor.shape()[0];
+    size_t ncol = tensor.size() / dim;
+    size_t gate_dim = gate_op.shape()[0];
+    if (dim != states.size()) throw std::runtime_error("tensor leading dimension != states.size()");
+    if (gate_dim != (1ULL<<qubits.size())) throw std::runtime_error("gate_op is not shape (2**len(qubits),)*2");
+
+    std::vector<size_t> offsets(gate_dim);
+    for (size_t l1 = 0; l1 < gate_dim; l1++) {
+        size_t l2 = 0;
+        for (size_t q1 = 0; q1 < qubits.size(); q1++) {
+            l2 += ((l1 >> q1) & 1ULL) << qubits[q1];
         }
+        offsets[l1] = l2;
+    }
+    size_t mask = offsets[gate_dim - 1];
+
+    // Gate-local indices of each local weight
+    std::vector<std::vector<size_t>> locals(qubits.size() + 1);
+    for (size_t l = 0; l < gate_dim; l++) {
+        locals[__builtin_popcountll(l)].push_back(l);
+    }
 
-        for (size_t k1 = 0; k1 < 1ULL<<oubits.size(); k1++ ) {
-            size_t k2 = 0;
-            for (size_t o1 = 0; o1 < oubits.size(); o1++) {
-                size_t o2 = oubits[o1];
-                k2 += ((k1 & (1 << o1)) >> o1) << o2;
+    // Each group is identified by its first row; its members are the rows of
+    // locals[local_weight] with the non-gate bits of that row
+    std::vector<std::pair<size_t, std::vector<size_t>>> groups;
+    for (size_t row = 0; row < dim; row++) {
+        size_t local = 0;
+        for (size_t q1 = 0; q1 < qubits.size(); q1++) {
+            local |= ((states[row] >> qubits[q1]) & 1ULL) << q1;
+        }
+        size_t local_weight = __builtin_popcountll(local);
+        if (local != locals[local_weight][0]) continue;
+        std::vector<size_t> rows;
+        for (auto l : locals[local_weight]) {
+            size_t state = (states[row] & ~mask) | offsets[l];
+            rows.push_back(std::lower_bound(states.begin(), states.end(), state) - states.begin());
+        }
+        groups.push_back(std::make_pair(local_weight, rows));
+    }
+
+    std::vector<TrigPolynomial>& data = tensor.data();
+    const std::vector<TrigPolynomial>& gate_data = gate_op.data();
+    const size_t ngroup = groups.size() * ncol;
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel num_threads(Parallel::num_threads())
+    {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        std::vector<TrigPolynomial> old(gate_dim);
+        TrigAccumulator accumulator;
+        #pragma omp for schedule(dynamic, 16)
+        for (ssize_t group = 0; group < (ssize_t) ngroup; group++) {
+            const std::vector<size_t>& ls = locals[groups[group / ncol].first];
+            const std::vector<size_t>& rows = groups[group / ncol].second;
+            size_t col = group % ncol;
+            for (size_t m = 0; m < rows.size(); m++) {
+                old[m] = std::move(data[rows[m] * ncol + col]);
             }
-            for (size_t l1 = 0; l1 < 1ULL<<qubits; l1++) {
-                size_t l2 = 0;
-                for (size_t q1 = 0; q1 < qubits; q1++) {
-                    size_t q2 = gate.first.second[q1];
-                    l2 += ((l1 & (1 << q1)) >> q1) << q2;
+            for (size_t l = 0; l < rows.size(); l++) {
+                for (size_t m = 0; m < rows.size(); m++) {
+                    accumulator.add_product(gate_data[ls[l] * gate_dim + ls[m]].terms(), old[m].terms());
                 }
-                for (size_t m1 = 0; m1 < 1ULL<<qubits; m1++) {
-                    size_t m2 = 0;
-                    for (size_t r1 = 0; r1 < qubits; r1++) {
-                        size_t r2 = gate.first.second[r1];
-                        m2 += ((m1 & (1 << r1)) >> r1) << r2;
+                data[rows[l] * ncol + col] = TrigPolynomial::from_terms(accumulator.terms());
+            }
+        }
+    }
+}
+
+// Greedily merges each gate into the most recent block touching its qubits,
+// as long as the merged block acts on at most max_nqubit qubits. A gate is only
+// merged into the latest block on each of its qubits, so moving it earlier
+// past other blocks only crosses blocks it commutes with. Each fused block's
+// 2^k x 2^k matrix is formed with apply_gate at block size, and blocks are
+// rescheduled as soon as possible in time. Returns the fused circuit and the
+// number of gates absorbed into earlier blocks.
+std::pair<Circuit, size_t> fused(size_t max_nqubit) const
+{
+    struct Block {
+        std::vector<size_t> qubits;
+        std::vector<const std::pair<const circuit_key_t, Gate>*> gates;
+    };
+    std::vector<Block> blocks;
+    std::map<size_t, size_t> last_block;
+
+    for (auto const& gate : gates_) {
+        const std::vector<size_t>& qubits = gate.first.second;
+        bool found = false;
+        size_t candidate = 0;
+        for (auto qubit : qubits) {
+            auto it = last_block.find(qubit);
+            if (it == last_block.end()) continue;
+            candidate = found ? std::max(candidate, it->second) : it->second;
+            found = true;
+        }
+        if (found) {
+            std::set<size_t> merged(blocks[candidate].qubits.begin(), blocks[candidate].qubits.end());
+            merged.insert(qubits.begin(), qubits.end());
+            if (merged.size() > max_nqubit) found = false;
+            else blocks[candidate].qubits.assign(merged.begin(), merged.end());
+        }
+        if (!found) {
+            candidate = blocks.size();
+            blocks.push_back(Block());
+            blocks.back().qubits = qubits;
+            std::sort(blocks.back().qubits.begin(), blocks.back().qubits.end());
+        }
+        blocks[candidate].gates.push_back(&gate);
+        for (auto qubit : qubits) {
+            last_block[qubit] = candidate;
+        }
+    }
+
+    Circuit circuit;
+    std::map<size_t, size_t> next_time;
+    for (auto const& block : blocks) {
+        size_t time = 0;
+        for (auto qubit : block.qubits) {
+            auto it = next_time.find(qubit);
+            if (it != next_time.end()) time = std::max(time, it->second);
+        }
+        for (auto qubit : block.qubits) {
+            next_time[qubit] = time + 1;
+        }
+
+        if (block.gates.size() == 1) {
+            circuit.add_gate(time, block.gates[0]->first.second, block.gates[0]->second);
+            continue;
+        }
+
+        size_t dim = 1ULL<<block.qubits.size();
+        TrigTensor matrix(std::vector<size_t>{dim, dim});
+        for (size_t index = 0; index < dim; index++) {
+            matrix.data()[index*dim + index] = TrigPolynomial::one();
+        }
+        for (auto gate : block.gates) {
+            std::vector<size_t> local_qubits;
+            for (auto qubit : gate->first.second) {
+                local_qubits.push_back(std::lower_bound(block.qubits.begin(), block.qubits.end(), qubit) - block.qubits.begin());
+            }
+            apply_gate(matrix, local_qubits, gate->second.matrix());
+        }
+        std::vector<std::string> ascii_symbols(block.qubits.size(), "F");
+        circuit.add_gate(time, block.qubits, Gate(block.qubits.size(), matrix, ascii_symbols));
+    }
+    return std::make_pair(circuit, gates_.size() - circuit.gates().size());
+}
+
+// A set of gates on disjoint qubits, each given as (qubits, gate matrix)
+template <typename Tensor>
+using basic_layer_t = std::vector<std::pair<std::vector<size_t>, const Tensor*>>;
+typedef basic_layer_t<TrigTensor> layer_t;
+
+// Upper bound on the number of qubits swept together by apply_layer. A time
+// slice touching more qubits is split into several layers, which keeps the
+// per-thread gather buffer (2^layer_nqubit polynomials) cache-sized and leaves
+// enough row groups to spread across threads in statevector mode.
+static const size_t max_layer_nqubit = 10;
+
+// Left-multiplies tensor (leading dimension 2^n, remaining dimensions flattened
+// into columns) in place by gate_op acting on qubits. No 2^n x 2^n embedding of
+// gate_op is formed, so the cost is O(size * 2^k).
+static void apply_gate(
+    TrigTensor& tensor,
+    const std::vector<size_t>& qubits,
+    const TrigTensor& gate_op)
+{
+    apply_layer(tensor, layer_t(1, std::make_pair(qubits, &gate_op)));
+}
+
+// Left-multiplies tensor in place by the tensor product of the gates in layer,
+// which must act on disjoint qubits. Each 2^L group of rows which differ only in
+// the L layer qubits is gathered once, every gate is applied to the gathered
+// group in turn, and the group is scattered back, so each tensor entry is
+// visited once per layer rather than once per gate.
+template <typename Tensor>
+static void apply_layer(
+    Tensor& tensor,
+    const basic_layer_t<Tensor>& layer)
+{
+    typedef typename Tensor::polynomial_t Polynomial;
+
+    size_t dim = tensor.shape()[0];
+    size_t ncol = tensor.size() / dim;
+
+    std::vector<size_t> layer_qubits;
+    for (auto const& gate : layer) {
+        if (gate.second->shape()[0] != (1ULL<<gate.first.size())) throw std::runtime_error("gate_op is not shape (2**len(qubits),)*2");
+        layer_qubits.insert(layer_qubits.end(), gate.first.begin(), gate.first.end());
+    }
+    std::sort(layer_qubits.begin(), layer_qubits.end());
+    if (std::adjacent_find(layer_qubits.begin(), layer_qubits.end()) != layer_qubits.end()) throw std::runtime_error("layer gates must act on disjoint qubits");
+
+    size_t mask = 0;
+    for (auto qubit : layer_qubits) {
+        if ((1ULL<<qubit) >= dim) throw std::runtime_error("qubit index exceeds tensor dimension");
+        mask |= 1ULL<<qubit;
+    }
+
+    // Row offsets of the gathered group, and for each gate the offsets of its
+    // 2^k rows and the bases of its 2^(L-k) subgroups within the gathered group
+    size_t layer_dim = 1ULL<<layer_qubits.size();
+    std::vector<size_t> offsets(layer_dim);
+    for (size_t index = 0; index < layer_dim; index++) {
+        offsets[index] = deposit(index, mask);
+    }
+    size_t max_gate_dim = 0;
+    std::vector<std::vector<size_t>> gate_offsets(layer.size());
+    std::vector<std::vector<size_t>> gate_bases(layer.size());
+    for (size_t gate = 0; gate < layer.size(); gate++) {
+        const std::vector<size_t>& qubits = layer[gate].first;
+        size_t gate_dim = 1ULL<<qubits.size();
+        max_gate_dim = std::max(max_gate_dim, gate_dim);
+        size_t local_mask = 0;
+        std::vector<size_t> local_qubits;
+        for (auto qubit : qubits) {
+            local_qubits.push_back(std::lower_bound(layer_qubits.begin(), layer_qubits.end(), qubit) - layer_qubits.begin());
+            local_mask |= 1ULL<<local_qubits.back();
+        }
+        for (size_t l1 = 0; l1 < gate_dim; l1++) {
+            size_t l2 = 0;
+            for (size_t q1 = 0; q1 < local_qubits.size(); q1++) {
+                l2 += ((l1 >> q1) & 1ULL) << local_qubits[q1];
+            }
+            gate_offsets[gate].push_back(l2);
+        }
+        for (size_t group = 0; group < (layer_dim / gate_dim); group++) {
+            gate_bases[gate].push_back(deposit(group, (layer_dim - 1) & ~local_mask));
+        }
+    }
+
+    std::vector<Polynomial>& data = tensor.data();
+    const size_t ngroup = (dim >> layer_qubits.size()) * ncol;
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel num_threads(Parallel::num_threads())
+    {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        std::vector<Polynomial> local(layer_dim);
+        std::vector<Polynomial> old(max_gate_dim);
+        typename Polynomial::accumulator_t accumulator;
+        #pragma omp for schedule(dynamic, 16)
+        for (ssize_t group = 0; group < (ssize_t) ngroup; group++) {
+            size_t base = deposit(group / ncol, ~mask);
+            size_t col = group % ncol;
+            for (size_t index = 0; index < layer_dim; index++) {
+                local[index] = std::move(data[(base + offsets[index]) * ncol + col]);
+            }
+            for (size_t gate = 0; gate < layer.size(); gate++) {
+                const std::vector<Polynomial>& gate_data = layer[gate].second->data();
+                const std::vector<size_t>& loffsets = gate_offsets[gate];
+                size_t gate_dim = loffsets.size();
+                for (auto lbase : gate_bases[gate]) {
+                    for (size_t m = 0; m < gate_dim; m++) {
+                        old[m] = std::move(local[lbase + loffsets[m]]);
+                    }
+                    for (size_t l = 0; l < gate_dim; l++) {
+                        for (size_t m = 0; m < gate_dim; m++) {
+                            const Polynomial& gate_entry = gate_data[l * gate_dim + m];
+                            if (gate_entry.terms().empty() || old[m].terms().empty()) continue;
+                            accumulator.add_product(gate_entry.terms(), old[m].terms());
+                        }
+                        local[lbase + loffsets[l]] = Polynomial::from_terms(accumulator.terms());
                     }
-                    mat2.data()[(k2 + l2) * dim + (k2 + m2)] = gate_op.data()[l1 * gate_dim + m1];
                 }
             }
+            for (size_t index = 0; index < layer_dim; index++) {
+                data[(base + offsets[index]) * ncol + col] = std::move(local[index]);
+            }
         }
-        mat = TrigTensor::gemm(mat2,mat);
     }
-    return mat;
 }
 
 private:
 
+// Two independently seeded 64-bit FNV-1a lanes, mixed into a 128-bit digest
+class Hasher {
+public:
+Hasher() : a_(0xCBF29CE484222325ULL), b_(0x84222325CBF29CE4ULL) {}
+void add(const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t index = 0; index < size; index++) {
+        a_ = (a_ ^ bytes[index]) * 0x100000001B3ULL;
+        b_ = (b_ ^ bytes[index]) * 0x100000001B3ULL + 0x9E3779B97F4A7C15ULL;
+    }
+}
+void add(uint64_t value) { add(&value, sizeof(value)); }
+void add(double value) { add(&value, sizeof(value)); }
+void add(const std::string& value) { add((uint64_t) value.size()); add(value.data(), value.size()); }
+std::string hex() const
+{
+    char buffer[33];
+    snprintf(buffer, sizeof(buffer), "%016llx%016llx", (unsigned long long) mix(a_ ^ (b_ >> 1)), (unsigned long long) mix(b_ ^ (a_ << 1)));
+    return buffer;
+}
+private:
+uint64_t a_;
+uint64_t b_;
+static uint64_t mix(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+};
+
+// The gates in [first, last) grouped by time slice, in time order. A slice is
+// split into several layers when it touches more than max_layer_nqubit qubits.
+std::vector<layer_t> layers(gate_iterator first, gate_iterator last) const
+{
+    std::vector<layer_t> layers;
+    size_t time = 0;
+    size_t layer_nqubit = 0;
+    for (auto gate = first; gate != last; ++gate) {
+        const std::vector<size_t>& qubits = gate->first.second;
+        if (layers.empty() || gate->first.first != time || layer_nqubit + qubits.size() > max_layer_nqubit) {
+            layers.push_back(layer_t());
+            time = gate->first.first;
+            layer_nqubit = 0;
+        }
+        layers.back().push_back(std::make_pair(qubits, &gate->second.matrix()));
+        layer_nqubit += qubits.size();
+    }
+    return layers;
+}
+
+// Applies the layers of the whole circuit to tensor, with each gate operator
+// mapped through op
+template <typename Tensor, typename Operator>
+void apply_layers(Tensor& tensor, Operator op) const
+{
+    apply_layers(tensor, op, gates_.begin(), gates_.end());
+}
+
+// Applies layers(first, last) to tensor, with each gate operator mapped through
+// op. While the Profiler is enabled each layer is recorded.
+template <typename Tensor, typename Operator>
+void apply_layers(Tensor& tensor, Operator op, gate_iterator first, gate_iterator last) const
+{
+    gate_iterator gate = first;
+    for (auto const& layer : layers(first, last)) {
+        basic_layer_t<Tensor> ops;
+        for (auto const& layer_gate : layer) {
+            ops.push_back(std::make_pair(layer_gate.first, op(layer_gate.second)));
+        }
+        std::unique_ptr<Profiler::Span> span;
+        if (Profiler::enabled()) {
+            size_t time = gate->first.first;
+            std::vector<size_t> qubits;
+            std::vector<std::string> ascii_symbols;
+            for (size_t index = 0; index < layer.size(); index++, ++gate) {
+                qubits.insert(qubits.end(), gate->first.second.begin(), gate->first.second.end());
+                const std::vector<std::string>& gate_symbols = gate->second.ascii_symbols();
+                ascii_symbols.insert(ascii_symbols.end(), gate_symbols.begin(), gate_symbols.end());
+            }
+            span.reset(new Profiler::Span("layer", time, qubits, ascii_symbols));
+        }
+        apply_layer(tensor, ops);
+        if (span) span->finish(tensor.data());
+    }
+}
+
+// The gates of time slice time
+gate_iterator slice_begin(size_t time) const { return gates_.lower_bound(circuit_key_t(time, std::vector<size_t>())); }
+gate_iterator slice_end(size_t time) const { return gates_.lower_bound(circuit_key_t(time + 1, std::vector<size_t>())); }
+
+static TrigTensor identity(size_t dim)
+{
+    TrigTensor mat(std::vector<size_t>{dim, dim});
+    for (size_t index = 0; index < dim; index++) {
+        mat.data()[index*dim + index] = TrigPolynomial::one();
+    }
+    return mat;
+}
+
+void invalidate(size_t time)
+{
+    std::lock_guard<std::mutex> lock(prefixes_.mutex);
+    prefixes_.products.erase(prefixes_.products.lower_bound(time), prefixes_.products.end());
+}
+
+// The operator of each time slice, in time order
+std::vector<TrigTensor> slice_matrices() const
+{
+    const std::vector<size_t> times(times_.begin(), times_.end());
+    std::vector<TrigTensor> ops(times.size());
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel for schedule(dynamic) num_threads(Parallel::num_threads())
+    for (ssize_t index = 0; index < (ssize_t) times.size(); index++) {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        ops[index] = identity(1ULL<<nqubit());
+        apply_layers(ops[index], [](const TrigTensor* gate_op) { return gate_op; }, slice_begin(times[index]), slice_end(times[index]));
+    }
+    return ops;
+}
+
+TrigTensor tree_matrix() const
+{
+    std::vector<TrigTensor> ops = slice_matrices();
+    if (ops.empty()) return identity(1ULL<<nqubit());
+
+    // Each level multiplies pairs (later slice on the left); with a single
+    // pair the gemm itself runs in parallel instead
+    while (ops.size() > 1) {
+        const size_t npair = ops.size() / 2;
+        std::vector<TrigTensor> products((ops.size() + 1) / 2);
+        TrigSieve::Scope* sieve = TrigSieve::current();
+        #pragma omp parallel for schedule(dynamic) num_threads(npair > 1 ? Parallel::num_threads() : 1)
+        for (ssize_t pair = 0; pair < (ssize_t) npair; pair++) {
+            TrigSieve::Scope sieve_scope(sieve);
+            products[pair] = TrigTensor::gemm(ops[2*pair + 1], ops[2*pair]);
+        }
+        if (ops.size() % 2) products.back() = std::move(ops.back());
+        ops = std::move(products);
+    }
+    return ops[0];
+}
+
+TrigTensor greedy_matrix() const
+{
+    std::vector<TrigTensor> ops = slice_matrices();
+    if (ops.empty()) return identity(1ULL<<nqubit());
+
+    // costs[index] is the number of term multiplies in gemm(ops[index + 1], ops[index])
+    std::vector<size_t> costs;
+    for (size_t index = 0; index + 1 < ops.size(); index++) {
+        costs.push_back(gemm_nmultiply(ops[index + 1], ops[index]));
+    }
+    while (ops.size() > 1) {
+        size_t index = std::min_element(costs.begin(), costs.end()) - costs.begin();
+        ops[index] = TrigTensor::gemm(ops[index + 1], ops[index]);
+        ops.erase(ops.begin() + index + 1);
+        costs.erase(costs.begin() + index);
+        if (index > 0) costs[index - 1] = gemm_nmultiply(ops[index], ops[index - 1]);
+        if (index < costs.size()) costs[index] = gemm_nmultiply(ops[index + 1], ops[index]);
+    }
+    return ops[0];
+}
+
+// Term multiplies done by TrigTensor::gemm(a, b): the sum over k of the terms in
+// column k of a times the terms in row k of b
+static size_t gemm_nmultiply(const TrigTensor& a, const TrigTensor& b)
+{
+    const size_t dim = a.shape()[0];
+    size_t nmultiply = 0;
+    for (size_t k = 0; k < dim; k++) {
+        size_t aterms = 0;
+        size_t bterms = 0;
+        for (size_t index = 0; index < dim; index++) {
+            aterms += a.data()[index*dim + k].terms().size();
+            bterms += b.data()[k*dim + index].terms().size();
+        }
+        nmultiply += aterms * bterms;
+    }
+    return nmultiply;
+}
+
+TrigTensor incremental_matrix() const
+{
+    std::lock_guard<std::mutex> lock(prefixes_.mutex);
+    std::map<size_t, TrigTensor>& products = prefixes_.products;
+
+    // Prefixes depend on the qubit count and on the TrigSieve cutoff in force
+    if (prefixes_.nqubit != nqubit() || prefixes_.cutoff != TrigSieve::cutoff()) {
+        products.clear();
+        prefixes_.nqubit = nqubit();
+        prefixes_.cutoff = TrigSieve::cutoff();
+    }
+    if (times_.empty()) return identity(1ULL<<nqubit());
+
+    // products always covers a leading run of times_
+    auto time = times_.begin();
+    if (!products.empty()) time = times_.upper_bound(products.rbegin()->first);
+    TrigTensor prefix = products.empty() ? identity(1ULL<<nqubit()) : products.rbegin()->second;
+    for (; time != times_.end(); ++time) {
+        apply_layers(prefix, [](const TrigTensor* gate_op) { return gate_op; }, slice_begin(*time), slice_end(*time));
+        products[*time] = prefix;
+    }
+    return prefix;
+}
+
+// Scatters the low bits of bits into the set bit positions of mask
+static size_t deposit(size_t bits, size_t mask)
+{
+    size_t result = 0;
+    for (; bits && mask; mask &= mask - 1, bits >>= 1) {
+        if (bits & 1) result |= mask & (~mask + 1);
+    }
+    return result;
+}
+
 std::map<circuit_key_t, Gate> gates_;
 std::set<size_t> qubits_;
 std::set<size_t> times_;
 std::set<std::pair<size_t, size_t>> times_and_qubits_;
 
+// Incremental-mode prefix products, keyed by the last time each covers, and
+// the qubit count and cutoff they were built with. matrix() fills them in from
+// const calls, possibly on several threads, so they are guarded by mutex.
+// Copies take the products but not the lock.
+struct Prefixes {
+    Prefixes() : nqubit(0), cutoff(0.0) {}
+    Prefixes(const Prefixes& other) : nqubit(0), cutoff(0.0) { *this = other; }
+    Prefixes& operator=(const Prefixes& other)
+    {
+        if (this == &other) return *this;
+        std::lock(mutex, other.mutex);
+        std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+        std::lock_guard<std::mutex> other_lock(other.mutex, std::adopt_lock);
+        products = other.products;
+        nqubit = other.nqubit;
+        cutoff = other.cutoff;
+        return *this;
+    }
+    std::map<size_t, TrigTensor> products;
+    size_t nqubit;
+    double cutoff;
+    mutable std::mutex mutex;
+};
+
+bool incremental_;
+mutable Prefixes prefixes_;
+
 };
 
 } // namespace autogate
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "circuit.hpp"
+#include <limits>
+
+namespace autogate {
+
+// A greedy contraction order for a CircuitNetwork, and its predicted cost.
+// Network tensors are numbered in creation order: the gate tensors first, then
+// one identity per qubit the circuit never touches, then each contraction
+// result in turn. Step s contracts tensors steps[s] into tensor ntensor + s.
+struct ContractionPlan {
+    size_t ntensor;
+    std::vector<std::pair<size_t, size_t>> steps;
+    // Polynomial products over all steps, the largest intermediate tensor (in
+    // entries), and the rank of the final tensor
+    double nproduct;
+    double max_entries;
+    size_t nleg;
+};
+
+// Tensor-network view of a Circuit, for amplitudes <x|U|y> and small blocks of
+// U when the 2^n x 2^n unitary is too large to form. Each gate on k qubits is a
+// rank-2k tensor of TrigPolynomials with one leg per wire segment; boundary legs
+// are fixed to the bits of x and y (qiskit ordering: bit q is qubit q) before
+// contraction, and legs of open qubits are left open. Every leg has dimension 2,
+// so contracting two tensors costs 2^|union of their legs| polynomial products.
+// amplitude and block refuse plans whose largest intermediate tensor exceeds
+// max_entries() entries, rather than running out of memory partway through.
+class CircuitNetwork {
+
+public:
+
+static const size_t default_max_entries = 1ULL<<24;
+
+CircuitNetwork(const Circuit& circuit) :
+    nqubit_(circuit.nqubit()),
+    max_entries_(default_max_entries)
+{
+    if (nqubit_ > 64) throw std::runtime_error("CircuitNetwork supports at most 64 qubits");
+    std::vector<size_t> wires(nqubit_);
+    for (size_t qubit = 0; qubit < nqubit_; qubit++) {
+        wires[qubit] = qubit;
+        inputs_.push_back(qubit);
+    }
+    size_t nleg = nqubit_;
+    for (auto const& gate : circuit.gates()) {
+        const std::vector<size_t>& qubits = gate.first.second;
+        Tensor tensor;
+        std::vector<size_t> input_legs;
+        for (auto qubit : qubits) {
+            input_legs.push_back(wires[qubit]);
+            tensor.legs.push_back(nleg);
+            wires[qubit] = nleg++;
+        }
+        tensor.legs.insert(tensor.legs.end(), input_legs.begin(), input_legs.end());
+        // Leg p is bit p of the data index: output bits low, input bits high
+        const size_t gate_dim = 1ULL<<qubits.size();
+        const std::vector<TrigPolynomial>& gate_data = gate.second.matrix().data();
+        tensor.data.resize(gate_dim * gate_dim);
+        for (size_t l = 0; l < gate_dim; l++) {
+            for (size_t m = 0; m < gate_dim; m++) {
+                tensor.data[l + m * gate_dim] = gate_data[l * gate_dim + m];
+            }
+        }
+        tensors_.push_back(std::move(tensor));
+    }
+    for (size_t qubit = 0; qubit < nqubit_; qubit++) {
+        if (wires[qubit] != inputs_[qubit]) continue;
+        Tensor tensor;
+        tensor.legs = {nleg, inputs_[qubit]};
+        tensor.data = {TrigPolynomial::one(), TrigPolynomial::zero(), TrigPolynomial::zero(), TrigPolynomial::one()};
+        wires[qubit] = nleg++;
+        tensors_.push_back(std::move(tensor));
+    }
+    outputs_ = wires;
+
+    boundary_qubits_.assign(nleg, -1);
+    for (size_t qubit = 0; qubit < nqubit_; qubit++) {
+        boundary_qubits_[inputs_[qubit]] = qubit;
+        boundary_qubits_[outputs_[qubit]] = qubit;
+    }
+}
+
+size_t nqubit() const { return nqubit_; }
+size_t ntensor() const { return tensors_.size(); }
+
+// Largest intermediate tensor (in entries) that amplitude and block will form
+double max_entries() const { return max_entries_; }
+
+void set_max_entries(double max_entries)
+{
+    if (!(max_entries >= 1.0)) throw std::runtime_error("max_entries must be >= 1");
+    max_entries_ = max_entries;
+}
+
+// The greedy contraction order for amplitude (no open qubits) or for
+// block(open_qubits, ...), which depends only on which qubits are open
+ContractionPlan plan(const std::vector<size_t>& open_qubits=std::vector<size_t>()) const
+{
+    std::vector<std::vector<size_t>> legs;
+    for (auto const& tensor : tensors_) {
+        legs.push_back(open_legs(tensor.legs, open_mask(open_qubits)));
+    }
+
+    ContractionPlan plan;
+    plan.ntensor = legs.size();
+    plan.nproduct = 0.0;
+    plan.max_entries = 0.0;
+    std::vector<bool> alive(legs.size(), true);
+    for (size_t remaining = legs.size(); remaining > 1; remaining--) {
+        // Cheapest pair sharing a leg; disconnected pairs (outer products) only
+        // when no pair shares one, smallest result first
+        size_t besta = 0, bestb = 0;
+        bool best_shared = false;
+        size_t best_cost = std::numeric_limits<size_t>::max();
+        for (size_t a = 0; a < legs.size(); a++) {
+            if (!alive[a]) continue;
+            for (size_t b = a + 1; b < legs.size(); b++) {
+                if (!alive[b]) continue;
+                size_t nshared = shared_legs(legs[a], legs[b]).size();
+                size_t cost = legs[a].size() + legs[b].size() - nshared;
+                bool shared = nshared > 0;
+                if ((shared && !best_shared) || (shared == best_shared && cost < best_cost)) {
+                    besta = a;
+                    bestb = b;
+                    best_shared = shared;
+                    best_cost = cost;
+                }
+            }
+        }
+        std::vector<size_t> result = result_legs(legs[besta], legs[bestb]);
+        plan.steps.push_back(std::make_pair(besta, bestb));
+        plan.nproduct += std::ldexp(1.0, best_cost);
+        plan.max_entries = std::max(plan.max_entries, std::ldexp(1.0, result.size()));
+        alive[besta] = alive[bestb] = false;
+        alive.push_back(true);
+        legs.push_back(std::move(result));
+    }
+    plan.nleg = legs.empty() ? 0 : legs.back().size();
+    return plan;
+}
+
+// <x|U|y>
+TrigPolynomial amplitude(size_t x, size_t y) const
+{
+    if (nqubit_ < 64 && ((x >> nqubit_) || (y >> nqubit_))) throw std::runtime_error("x and y must be < 2**nqubit");
+    Tensor result = contract(plan(), 0, x, y);
+    return result.data[0];
+}
+
+// The 2^m x 2^m block of U over the m open qubits, with every other qubit
+// fixed to its bit of x (output) and y (input). Row and column bit j is
+// open_qubits[j]; the bits of x and y on open qubits are ignored.
+TrigTensor block(const std::vector<size_t>& open_qubits, size_t x, size_t y) const
+{
+    size_t mask = open_mask(open_qubits);
+    if (nqubit_ < 64 && ((x >> nqubit_) || (y >> nqubit_))) throw std::runtime_error("x and y must be < 2**nqubit");
+    Tensor result = contract(plan(open_qubits), mask, x, y);
+
+    // Permute the open legs into (output bits, input bits) order
+    const size_t nopen = open_qubits.size();
+    std::vector<size_t> positions;
+    for (auto qubit : open_qubits) positions.push_back(leg_position(result, outputs_[qubit]));
+    for (auto qubit : open_qubits) positions.push_back(leg_position(result, inputs_[qubit]));
+    TrigTensor tensor(std::vector<size_t>{1ULL<<nopen, 1ULL<<nopen});
+    for (size_t index = 0; index < result.data.size(); index++) {
+        size_t row = 0, col = 0;
+        for (size_t j = 0; j < nopen; j++) {
+            row |= ((index >> positions[j]) & 1ULL) << j;
+            col |= ((index >> positions[nopen + j]) & 1ULL) << j;
+        }
+        tensor.data()[row * (1ULL<<nopen) + col] = result.data[index];
+    }
+    return tensor;
+}
+
+private:
+
+struct Tensor {
+    std::vector<size_t> legs;
+    std::vector<TrigPolynomial> data;
+};
+
+size_t nqubit_;
+double max_entries_;
+std::vector<Tensor> tensors_;
+// Boundary leg of each qubit at the start and end of the circuit, and the
+// qubit of each boundary leg (-1 for inner legs)
+std::vector<size_t> inputs_;
+std::vector<size_t> outputs_;
+std::vector<ssize_t> boundary_qubits_;
+
+size_t open_mask(const std::vector<size_t>& open_qubits) const
+{
+    size_t mask = 0;
+    for (auto qubit : open_qubits) {
+        if (qubit >= nqubit_) throw std::runtime_error("open qubit index >= nqubit");
+        if (mask & (1ULL<<qubit)) throw std::runtime_error("Repeated open qubit indices");
+        mask |= 1ULL<<qubit;
+    }
+    return mask;
+}
+
+// legs without the boundary legs of qubits outside mask
+std::vector<size_t> open_legs(const std::vector<size_t>& legs, size_t mask) const
+{
+    std::vector<size_t> result;
+    for (auto leg : legs) {
+        ssize_t qubit = boundary_qubit(leg);
+        if (qubit < 0 || (mask & (1ULL<<qubit))) result.push_back(leg);
+    }
+    return result;
+}
+
+ssize_t boundary_qubit(size_t leg) const { return boundary_qubits_[leg]; }
+
+static std::vector<size_t> shared_legs(const std::vector<size_t>& a, const std::vector<size_t>& b)
+{
+    std::vector<size_t> shared;
+    for (auto leg : a) {
+        if (std::find(b.begin(), b.end(), leg) != b.end()) shared.push_back(leg);
+    }
+    return shared;
+}
+
+// Legs of a then legs of b, without the shared ones
+static std::vector<size_t> result_legs(const std::vector<size_t>& a, const std::vector<size_t>& b)
+{
+    std::vector<size_t> result;
+    for (auto leg : a) {
+        if (std::find(b.begin(), b.end(), leg) == b.end()) result.push_back(leg);
+    }
+    for (auto leg : b) {
+        if (std::find(a.begin(), a.end(), leg) == a.end()) result.push_back(leg);
+    }
+    return result;
+}
+
+static size_t leg_position(const Tensor& tensor, size_t leg)
+{
+    return std::find(tensor.legs.begin(), tensor.legs.end(), leg) - tensor.legs.begin();
+}
+
+// tensor with each closed boundary leg fixed to its bit of x or y
+Tensor fix_boundary(const Tensor& tensor, size_t mask, size_t x, size_t y) const
+{
+    Tensor result;
+    size_t fixed_index = 0;
+    std::vector<size_t> kept;
+    for (size_t position = 0; position < tensor.legs.size(); position++) {
+        size_t leg = tensor.legs[position];
+        ssize_t qubit = boundary_qubit(leg);
+        if (qubit < 0 || (mask & (1ULL<<qubit))) {
+            result.legs.push_back(leg);
+            kept.push_back(position);
+            continue;
+        }
+        size_t bit = leg == inputs_[qubit] ? (y >> qubit) & 1ULL : (x >> qubit) & 1ULL;
+        fixed_index |= bit << position;
+    }
+    result.data.resize(1ULL<<kept.size());
+    for (size_t index = 0; index < result.data.size(); index++) {
+        size_t source = fixed_index;
+        for (size_t j = 0; j < kept.size(); j++) {
+            source |= ((index >> j) & 1ULL) << kept[j];
+        }
+        result.data[index] = tensor.data[source];
+    }
+    return result;
+}
+
+static Tensor contract_pair(const Tensor& a, const Tensor& b)
+{
+    std::vector<size_t> shared = shared_legs(a.legs, b.legs);
+    Tensor result;
+    result.legs = result_legs(a.legs, b.legs);
+    if (result.legs.size() >= 64) throw std::runtime_error("Contraction result has too many legs");
+
+    // Offsets into a and b of each result index and of each shared index
+    const size_t nresult = 1ULL<<result.legs.size();
+    const size_t nshared = 1ULL<<shared.size();
+    std::vector<size_t> aresult(nresult, 0), bresult(nresult, 0);
+    for (size_t index = 0; index < nresult; index++) {
+        for (size_t j = 0; j < result.legs.size(); j++) {
+            if (!((index >> j) & 1ULL)) continue;
+            size_t aposition = leg_position(a, result.legs[j]);
+            if (aposition < a.legs.size()) aresult[index] |= 1ULL << aposition;
+            else bresult[index] |= 1ULL << leg_position(b, result.legs[j]);
+        }
+    }
+    std::vector<size_t> ashared(nshared, 0), bshared(nshared, 0);
+    for (size_t index = 0; index < nshared; index++) {
+        for (size_t j = 0; j < shared.size(); j++) {
+            if (!((index >> j) & 1ULL)) continue;
+            ashared[index] |= 1ULL << leg_position(a, shared[j]);
+            bshared[index] |= 1ULL << leg_position(b, shared[j]);
+        }
+    }
+
+    result.data.resize(nresult);
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel num_threads(nresult > 64 ? Parallel::num_threads() : 1)
+    {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        TrigAccumulator accumulator;
+        #pragma omp for schedule(dynamic, 16)
+        for (ssize_t index = 0; index < (ssize_t) nresult; index++) {
+            for (size_t s = 0; s < nshared; s++) {
+                accumulator.add_product(a.data[aresult[index] | ashared[s]].terms(), b.data[bresult[index] | bshared[s]].terms());
+            }
+            result.data[index] = TrigPolynomial::from_terms(accumulator.terms());
+        }
+    }
+    return result;
+}
+
+Tensor contract(const ContractionPlan& plan, size_t mask, size_t x, size_t y) const
+{
+    if (plan.max_entries > max_entries_) {
+        throw std::runtime_error("Contraction needs an intermediate of " + std::to_string(plan.max_entries) +
+            " entries, more than max_entries " + std::to_string(max_entries_));
+    }
+    TrigArena::Scope arena_scope;
+    std::vector<Tensor> tensors;
+    for (auto const& tensor : tensors_) {
+        tensors.push_back(fix_boundary(tensor, mask, x, y));
+    }
+    if (tensors.empty()) {
+        Tensor scalar;
+        scalar.data = {TrigPolynomial::one()};
+        return scalar;
+    }
+    for (auto const& step : plan.steps) {
+        std::unique_ptr<Profiler::Span> span(Profiler::enabled() ? new Profiler::Span("contract") : nullptr);
+        tensors.push_back(contract_pair(tensors[step.first], tensors[step.second]));
+        if (span) span->finish(tensors.back().data);
+        tensors[step.first] = Tensor();
+        tensors[step.second] = Tensor();
+    }
+    return std::move(tensors.back());
+}
+
+};
+
+} // namespace autogate
@@ -0,0 +1,2 @@
+from .autogate_plugin import ContractionPlan
+from .autogate_plugin import CircuitNetwork
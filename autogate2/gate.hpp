@@ -2,7 +2,7 @@
 
 #include <vector>
 #include <cstddef>
-#include "trig_tensor.hpp"
+#include "trig_real.hpp"
 
 namespace autogate { 
 
@@ -28,6 +28,23 @@ uint32_t nqubit() const { return nqubit_; }
 const TrigTensor& matrix() const { return matrix_; }
 const std::vector<std::string>& ascii_symbols() const { return ascii_symbols_; }
 
+// True if every structurally nonzero matrix entry connects basis states of the
+// same Hamming weight, i.e. the gate conserves excitation number
+bool conserves_weight() const
+{
+    size_t dim = 1ULL<<nqubit_;
+    for (size_t l = 0; l < dim; l++) {
+        for (size_t m = 0; m < dim; m++) {
+            if (matrix_.data()[l*dim + m].terms().empty()) continue;
+            if (__builtin_popcountll(l) != __builtin_popcountll(m)) return false;
+        }
+    }
+    return true;
+}
+
+// True if the matrix is real for all real symbol values
+bool real() const { return RealTrigTensor::is_real(matrix_); }
+
 private: 
 
 uint32_t nqubit_;
@@ -109,7 +126,7 @@ Gate H()
 }
 
 static
-Gate Ry(char symbol, int order=1)
+Gate Ry(const TrigSymbol& symbol, int order=1)
 {
     uint32_t nqubit = 1;
     std::vector<size_t> dim = {(1ULL<<nqubit), (1ULL<<nqubit)};
@@ -250,7 +267,7 @@ Gate cH()
 }
 
 static
-Gate cRy(char symbol, int order=1)
+Gate cRy(const TrigSymbol& symbol, int order=1)
 {
     uint32_t nqubit = 2;
     std::vector<size_t> dim = {(1ULL<<nqubit), (1ULL<<nqubit)};
@@ -267,7 +284,7 @@ Gate cRy(char symbol, int order=1)
 }
 
 static
-Gate G(char symbol, int order=1)
+Gate G(const TrigSymbol& symbol, int order=1)
 {
     uint32_t nqubit = 2;
     std::vector<size_t> dim = {(1ULL<<nqubit), (1ULL<<nqubit)};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "binary_io.hpp"
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace autogate {
+
+// On-disk cache of Circuit::matrix results, keyed by Circuit::matrix_key. Each
+// entry is a BinaryIO tensor file named <key>.agt in the cache directory.
+// Writers store to a uniquely named temporary file and rename(2) it into place,
+// so processes sharing the directory never observe a partial entry; concurrent
+// writers of the same key write identical content and the last rename wins.
+// The cache is only an optimization: unreadable entries are misses and failed
+// writes are counted, never thrown.
+class MatrixCache {
+
+public:
+
+// The cache directory, or "" if caching is disabled (the default)
+static std::string directory()
+{
+    std::lock_guard<std::mutex> lock(mutex());
+    return directory_setting();
+}
+
+static void set_directory(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(mutex());
+    directory_setting() = directory;
+}
+
+static bool enabled() { return !directory().empty(); }
+
+// Lookups and failed stores since the last reset_counters
+static size_t hits() { return hits_counter().load(); }
+static size_t misses() { return misses_counter().load(); }
+static size_t store_failures() { return store_failures_counter().load(); }
+static void reset_counters() { hits_counter().store(0); misses_counter().store(0); store_failures_counter().store(0); }
+
+// Loads the entry for key into tensor if present; unreadable entries are misses
+static bool load(const std::string& key, TrigTensor& tensor)
+{
+    try {
+        tensor = BinaryIO::load(path(key));
+    } catch (const std::runtime_error&) {
+        misses_counter()++;
+        return false;
+    }
+    hits_counter()++;
+    return true;
+}
+
+// Stores tensor as the entry for key. Returns false (and counts a store
+// failure) if the entry could not be written, e.g. if the directory is missing
+// or read-only.
+static bool store(const std::string& key, const TrigTensor& tensor)
+{
+    static std::atomic<size_t> counter(0);
+    std::string target = path(key);
+    std::string temporary = target + ".tmp." + std::to_string(::getpid()) + "." +
+        std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." + std::to_string(counter++);
+    try {
+        BinaryIO::save(tensor, temporary);
+    } catch (const std::runtime_error&) {
+        std::remove(temporary.c_str());
+        store_failures_counter()++;
+        return false;
+    }
+    if (std::rename(temporary.c_str(), target.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        store_failures_counter()++;
+        return false;
+    }
+    return true;
+}
+
+private:
+
+static std::string path(const std::string& key) { return directory() + "/" + key + ".agt"; }
+
+static std::mutex& mutex() { static std::mutex mutex; return mutex; }
+static std::string& directory_setting() { static std::string directory; return directory; }
+static std::atomic<size_t>& hits_counter() { static std::atomic<size_t> hits(0); return hits; }
+static std::atomic<size_t>& misses_counter() { static std::atomic<size_t> misses(0); return misses; }
+static std::atomic<size_t>& store_failures_counter() { static std::atomic<size_t> failures(0); return failures; }
+
+};
+
+} // namespace autogate
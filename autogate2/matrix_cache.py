@@ -0,0 +1 @@
+from .autogate_plugin import MatrixCache
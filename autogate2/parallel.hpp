@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace autogate {
+
+// Thread count used by the OpenMP regions in TrigTensor::gemm, Circuit::matrix
+// and friends. Every parallel loop assigns each output entry to exactly one
+// thread and accumulates it in a fixed order, so results are bitwise identical
+// for any thread count.
+class Parallel {
+
+public:
+
+// The configured thread count, or the OpenMP default if none was set
+static int num_threads()
+{
+    int nthread = num_threads_setting();
+#ifdef _OPENMP
+    return nthread > 0 ? nthread : omp_get_max_threads();
+#else
+    (void) nthread;
+    return 1;
+#endif
+}
+
+// 0 restores the OpenMP default
+static void set_num_threads(int nthread)
+{
+    if (nthread < 0) throw std::runtime_error("nthread must be >= 0");
+    num_threads_setting() = nthread;
+}
+
+private:
+
+static int& num_threads_setting() { static int nthread = 0; return nthread; }
+
+};
+
+} // namespace autogate
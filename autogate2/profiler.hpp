@@ -0,0 +1,120 @@
+#pragma once
+
+#include "trig.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace autogate {
+
+// One profiled step: a layer of gates applied by Circuit::matrix, apply or
+// real_matrix (qubits and ascii_symbols concatenate those of its gates), a
+// TrigTensor::gemm, or a CircuitNetwork contraction. Counts are TrigCounters
+// deltas over the step: nproduct polynomial multiplies, nmultiply terms created
+// by them, and nterm terms left after accumulation. The entry statistics
+// describe the step's output tensor.
+struct ProfileRecord {
+    std::string kind;
+    size_t time;
+    std::vector<size_t> qubits;
+    std::vector<std::string> ascii_symbols;
+    double seconds;
+    size_t nproduct;
+    size_t nmultiply;
+    size_t nterm;
+    size_t nentry;
+    size_t max_entry_terms;
+    double mean_entry_terms;
+};
+
+// Opt-in per-step profiling. While disabled (the default) instrumented code
+// only tests enabled(), a relaxed atomic load, so set_enabled may be called
+// while kernels run on other threads. While enabled, Circuit records each
+// layer it applies, with the same fused kernel as unprofiled runs. Counts come
+// from the process-wide TrigCounters, so open Spans are serialized: a step
+// that would run concurrently with another (e.g. the slices of the "tree"
+// ordering) waits for it, and only work outside instrumented code can still
+// leak into a record. Records are appended in completion order.
+class Profiler {
+
+public:
+
+static bool enabled() { return enabled_setting().load(std::memory_order_relaxed); }
+static void set_enabled(bool enabled) { enabled_setting().store(enabled, std::memory_order_relaxed); }
+
+static std::vector<ProfileRecord> records()
+{
+    std::lock_guard<std::mutex> lock(mutex());
+    return records_storage();
+}
+
+static void clear()
+{
+    std::lock_guard<std::mutex> lock(mutex());
+    records_storage().clear();
+}
+
+// Measures one step from construction to finish, holding the span lock
+class Span {
+public:
+Span(
+    const std::string& kind,
+    size_t time=0,
+    const std::vector<size_t>& qubits=std::vector<size_t>(),
+    const std::vector<std::string>& ascii_symbols=std::vector<std::string>()) :
+    lock_(span_mutex()),
+    start_(std::chrono::steady_clock::now()),
+    nproduct_(TrigCounters::nproduct()),
+    nmultiply_(TrigCounters::nmultiply()),
+    nterm_(TrigCounters::nterm())
+{
+    record_.kind = kind;
+    record_.time = time;
+    record_.qubits = qubits;
+    record_.ascii_symbols = ascii_symbols;
+}
+
+template <typename Polynomial>
+void finish(const std::vector<Polynomial>& output)
+{
+    record_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    record_.nproduct = TrigCounters::nproduct() - nproduct_;
+    record_.nmultiply = TrigCounters::nmultiply() - nmultiply_;
+    record_.nterm = TrigCounters::nterm() - nterm_;
+    record_.nentry = output.size();
+    record_.max_entry_terms = 0;
+    size_t nterm = 0;
+    for (auto const& poly : output) {
+        nterm += poly.terms().size();
+        record_.max_entry_terms = std::max(record_.max_entry_terms, poly.terms().size());
+    }
+    record_.mean_entry_terms = output.empty() ? 0.0 : nterm / (double) output.size();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        records_storage().push_back(record_);
+    }
+    lock_.unlock();
+}
+
+private:
+std::unique_lock<std::recursive_mutex> lock_;
+std::chrono::steady_clock::time_point start_;
+size_t nproduct_;
+size_t nmultiply_;
+size_t nterm_;
+ProfileRecord record_;
+};
+
+private:
+
+static std::atomic<bool>& enabled_setting() { static std::atomic<bool> enabled(false); return enabled; }
+static std::mutex& mutex() { static std::mutex mutex; return mutex; }
+static std::recursive_mutex& span_mutex() { static std::recursive_mutex mutex; return mutex; }
+static std::vector<ProfileRecord>& records_storage() { static std::vector<ProfileRecord> records; return records; }
+
+};
+
+} // namespace autogate
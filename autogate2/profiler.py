@@ -0,0 +1,9 @@
+from .autogate_plugin import Profiler
+from .autogate_plugin import ProfileRecord
+
+def _profile_record_repr(self):
+    return 'ProfileRecord(kind=%r, time=%d, qubits=%r, ascii_symbols=%r, seconds=%.3E, nproduct=%d, nmultiply=%d, nterm=%d, max_entry_terms=%d, mean_entry_terms=%.1f)' % (
+        self.kind, self.time, self.qubits, self.ascii_symbols, self.seconds,
+        self.nproduct, self.nmultiply, self.nterm, self.max_entry_terms, self.mean_entry_terms)
+
+ProfileRecord.__repr__ = _profile_record_repr
@@ -0,0 +1,109 @@
+// TrigArena storage for temporary product monomials
+
+#include "test_util.hpp"
+#include <future>
+#include <thread>
+
+using namespace autogate;
+
+// Monomial over the count symbols from first
+static TrigMonomial monomial(char first, size_t count)
+{
+    typedef decltype(TrigMonomial().variables()) variables_t;
+    variables_t variables;
+    for (size_t index = 0; index < count; index++) {
+        variables.push_back(variables_t::value_type((char) (first + index), 1));
+    }
+    return TrigMonomial(variables);
+}
+
+int main()
+{
+    TrigMonomial a = monomial('a', 4);
+    TrigMonomial b = monomial('m', 4);
+
+    // Temporary products only use the arena inside a Scope, and only past
+    // inline_capacity. Public products never do, so they outlive the Scope.
+    CHECK(!TrigMonomial::multiply_temporary(a, b).temporary());
+    TrigArena::reset_peak_size();
+    TrigMonomial kept;
+    {
+        TrigArena::Scope arena_scope;
+        CHECK(!TrigMonomial::multiply_temporary(monomial('a', 3), monomial('m', 3)).temporary());
+        kept = a * b;
+        CHECK(!kept.temporary());
+        TrigMonomial product = TrigMonomial::multiply_temporary(a, b);
+        CHECK(product.temporary());
+        CHECK(product.size() == 8);
+        CHECK(TrigMonomial(product) == product);
+        CHECK(!TrigMonomial(product).temporary());
+
+        // LIFO temporaries do not grow the arena
+        size_t size = TrigArena::current()->size();
+        for (size_t index = 0; index < 100000; index++) {
+            TrigMonomial temporary = TrigMonomial::multiply_temporary(a, b);
+        }
+        CHECK(TrigArena::current()->size() == size);
+        CHECK(TrigArena::total_size() >= size);
+    }
+    CHECK(TrigArena::current() == nullptr);
+    CHECK(kept == a * b);
+    CHECK(TrigArena::peak_size() >= TrigArena::block_size);
+
+    // peak_size sums the arenas live on all threads at once
+    TrigArena::reset_peak_size();
+    size_t total = TrigArena::total_size();
+    std::promise<void> allocated;
+    std::promise<void> measured;
+    std::shared_future<void> measured_future = measured.get_future().share();
+    std::future<void> other = std::async(std::launch::async, [&]() {
+        TrigArena::Scope arena_scope;
+        TrigMonomial product = TrigMonomial::multiply_temporary(a, b);
+        allocated.set_value();
+        measured_future.wait();
+    });
+    {
+        TrigArena::Scope arena_scope;
+        TrigMonomial product = TrigMonomial::multiply_temporary(a, b);
+        allocated.get_future().wait();
+        CHECK(TrigArena::total_size() == total + 2 * TrigArena::block_size);
+        measured.set_value();
+    }
+    other.get();
+    CHECK(TrigArena::total_size() == total);
+    CHECK(TrigArena::peak_size() == total + 2 * TrigArena::block_size);
+
+    // A temporary destroyed on another thread returns to the arena that made it
+    std::promise<TrigMonomial> handoff;
+    std::promise<void> destroyed;
+    std::future<void> destroyed_future = destroyed.get_future();
+    std::future<bool> reused = std::async(std::launch::async, [&]() {
+        TrigArena::Scope arena_scope;
+        TrigMonomial product = TrigMonomial::multiply_temporary(a, b);
+        const TrigMonomial::word_t* words = product.begin();
+        handoff.set_value(std::move(product));
+        destroyed_future.wait();
+        TrigMonomial next = TrigMonomial::multiply_temporary(a, b);
+        return next.begin() == words;
+    });
+    {
+        TrigArena::Scope arena_scope;
+        TrigMonomial moved = handoff.get_future().get();
+        CHECK(moved == a * b);
+    }
+    destroyed.set_value();
+    CHECK(reused.get());
+
+    // Circuits whose entries spill past inline_capacity give the same matrix
+    // on one thread and on several
+    Circuit circuit = autogate_test::brickwork(3, 3, 9);
+    Parallel::set_num_threads(1);
+    TrigArena::reset_peak_size();
+    TrigTensor serial = circuit.matrix();
+    CHECK(TrigArena::peak_size() > 0);
+    Parallel::set_num_threads(4);
+    CHECK(autogate_test::equivalent(circuit.matrix(), serial));
+    Parallel::set_num_threads(0);
+
+    return autogate_test::report("test_arena");
+}
@@ -0,0 +1,84 @@
+// BinaryIO round trips and rejection of corrupt files
+
+#include "test_util.hpp"
+#include "../binary_io.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+using namespace autogate;
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string& path, const std::string& data)
+{
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(data.data(), data.size());
+}
+
+// One-entry tensor holding the single monomial given by symbols and orders
+static TrigEvaluator monomial_evaluator(const std::vector<uint32_t>& symbols, const std::vector<int32_t>& orders)
+{
+    return TrigEvaluator(
+        {1},
+        {TrigSymbol("io_a"), TrigSymbol("io_b")},
+        {0, 1},
+        {std::complex<double>(1.0, 0.0)},
+        {0},
+        {0, symbols.size()},
+        symbols,
+        orders);
+}
+
+int main()
+{
+    std::string path = "/tmp/autogate_test_binary_io." + std::to_string(::getpid()) + ".agt";
+
+    // Tensors and circuits survive a round trip
+    Circuit circuit = autogate_test::brickwork(3, 2, 3, 'i');
+    TrigTensor matrix = circuit.matrix();
+    BinaryIO::save(matrix, path);
+    CHECK(autogate_test::equivalent(BinaryIO::load(path), matrix));
+    circuit.save(path);
+    CHECK(autogate_test::equivalent(Circuit::load(path).matrix(), matrix));
+
+    // Empty arrays (zero entries, no symbols) are fine
+    TrigTensor zero(std::vector<size_t>{2});
+    BinaryIO::save(zero, path);
+    CHECK(autogate_test::equivalent(BinaryIO::load(path), zero));
+
+    // A valid two-variable monomial loads
+    BinaryIO::save(monomial_evaluator({0, 1}, {1, -2}), path);
+    CHECK(BinaryIO::load(path).data()[0].terms().size() == 1);
+
+    // The variable arrays are the last two sections: symbols then orders, each
+    // 8 bytes for two variables
+    std::string valid = read_file(path);
+    std::string corrupt = valid;
+    corrupt[corrupt.size() - 12] = 7;
+    write_file(path, corrupt);
+    CHECK_THROWS(BinaryIO::load(path));
+
+    // Zero and INT32_MIN orders and repeated symbols
+    BinaryIO::save(monomial_evaluator({0, 1}, {1, 0}), path);
+    CHECK_THROWS(BinaryIO::load(path));
+    corrupt = valid;
+    int32_t order = INT32_MIN;
+    std::memcpy(&corrupt[corrupt.size() - 8], &order, sizeof(order));
+    write_file(path, corrupt);
+    CHECK_THROWS(BinaryIO::load(path));
+    BinaryIO::save(monomial_evaluator({1, 1}, {1, 1}), path);
+    CHECK_THROWS(BinaryIO::load(path));
+
+    // Truncation
+    write_file(path, valid.substr(0, valid.size() - 8));
+    CHECK_THROWS(BinaryIO::load(path));
+
+    std::remove(path.c_str());
+    return autogate_test::report("test_binary_io");
+}
@@ -0,0 +1,80 @@
+// TrigEvaluator against direct evaluation of each polynomial
+
+#include "test_util.hpp"
+#include "../trig_evaluator.hpp"
+
+using namespace autogate;
+
+typedef std::decay<decltype(TrigMonomial().variables()[0].first)>::type symbol_t;
+
+// poly at the given angle of each symbol
+static std::complex<double> value(const TrigPolynomial& poly, const std::map<symbol_t, double>& angles)
+{
+    std::complex<double> sum = 0.0;
+    for (auto const& term : poly.terms()) {
+        double phase = 0.0;
+        for (auto const& variable : term.first.variables()) {
+            phase += variable.second * angles.at(variable.first);
+        }
+        sum += term.second * std::exp(std::complex<double>(0.0, phase));
+    }
+    return sum;
+}
+
+int main()
+{
+    TrigTensor matrix = autogate_test::brickwork(3, 3, 3, 'e').matrix();
+    TrigEvaluator evaluator(matrix, {'e', 'f', 'g'});
+    auto const& symbols = evaluator.symbols();
+    CHECK(symbols.size() == 3);
+    CHECK(evaluator.size() == matrix.size());
+    CHECK(autogate_test::equivalent(evaluator.tensor(), matrix));
+
+    std::vector<double> angles = {0.3, -1.1, 2.5};
+    std::map<symbol_t, double> angle_map;
+    for (size_t index = 0; index < symbols.size(); index++) {
+        angle_map[symbols[index]] = angles[index];
+    }
+    std::vector<std::complex<double>> values = evaluator.evaluate(angles);
+    for (size_t entry = 0; entry < matrix.size(); entry++) {
+        CHECK(std::abs(values[entry] - value(matrix.data()[entry], angle_map)) < 1.0E-12);
+    }
+    CHECK_THROWS(evaluator.evaluate(std::vector<double>{0.0}));
+
+    // Batches agree with one evaluation per angle vector on any thread count
+    const size_t nbatch = 9;
+    std::vector<double> batch_angles;
+    for (size_t batch = 0; batch < nbatch; batch++) {
+        for (size_t index = 0; index < symbols.size(); index++) {
+            batch_angles.push_back(0.1 * batch - 0.7 * index);
+        }
+    }
+    std::vector<std::complex<double>> batch_values(nbatch * evaluator.size());
+    Parallel::set_num_threads(4);
+    evaluator.evaluate_batch(batch_angles.data(), nbatch, batch_values.data());
+    Parallel::set_num_threads(0);
+    for (size_t batch = 0; batch < nbatch; batch++) {
+        std::vector<double> single(batch_angles.begin() + batch * symbols.size(), batch_angles.begin() + (batch + 1) * symbols.size());
+        std::vector<std::complex<double>> expected = evaluator.evaluate(single);
+        for (size_t entry = 0; entry < evaluator.size(); entry++) {
+            CHECK(std::abs(batch_values[batch * evaluator.size() + entry] - expected[entry]) < 1.0E-14);
+        }
+    }
+
+    // Fused gradients agree with the values and with TrigTensor::derivative
+    std::vector<std::complex<double>> gradient_values(evaluator.size());
+    std::vector<std::complex<double>> gradients(symbols.size() * evaluator.size());
+    std::vector<std::complex<double>> scratch(evaluator.scratch_size());
+    evaluator.evaluate_gradient(angles.data(), gradient_values.data(), gradients.data(), scratch.data());
+    for (size_t index = 0; index < symbols.size(); index++) {
+        TrigTensor derivative = matrix.derivative(symbols[index]);
+        for (size_t entry = 0; entry < evaluator.size(); entry++) {
+            CHECK(std::abs(gradients[index * evaluator.size() + entry] - value(derivative.data()[entry], angle_map)) < 1.0E-12);
+        }
+    }
+    for (size_t entry = 0; entry < evaluator.size(); entry++) {
+        CHECK(std::abs(gradient_values[entry] - values[entry]) < 1.0E-14);
+    }
+
+    return autogate_test::report("test_evaluator");
+}
@@ -0,0 +1,25 @@
+// Circuit::fused against the unfused Circuit::matrix
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    Circuit circuit = autogate_test::brickwork(4, 4, 3);
+    circuit.add_gate(8, {0, 3}, GateLibrary::G('g'));
+    circuit.add_gate(9, {2}, GateLibrary::H());
+    TrigTensor matrix = circuit.matrix();
+
+    for (size_t max_nqubit : {1, 2, 3, 4}) {
+        std::pair<Circuit, size_t> fused = circuit.fused(max_nqubit);
+        CHECK(autogate_test::equivalent(fused.first.matrix(), matrix));
+        CHECK(fused.first.gates().size() + fused.second == circuit.gates().size());
+        for (auto const& gate : fused.first.gates()) {
+            CHECK(gate.first.second.size() <= std::max<size_t>(max_nqubit, 2));
+        }
+    }
+    CHECK(circuit.fused(2).second > 0);
+
+    return autogate_test::report("test_fused");
+}
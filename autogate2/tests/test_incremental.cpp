@@ -0,0 +1,85 @@
+// Incremental Circuit::matrix against a full rebuild after every edit
+
+#include "test_util.hpp"
+#include <thread>
+
+using namespace autogate;
+
+// A non-incremental copy of circuit, rebuilt gate by gate
+static Circuit rebuilt(const Circuit& circuit)
+{
+    Circuit copy;
+    for (auto const& gate : circuit.gates()) {
+        copy.add_gate(gate.first.first, gate.first.second, gate.second);
+    }
+    return copy;
+}
+
+static bool matches_rebuild(const Circuit& circuit)
+{
+    return autogate_test::equivalent(circuit.matrix(), rebuilt(circuit).matrix());
+}
+
+int main()
+{
+    Circuit circuit = autogate_test::brickwork(3, 6, 2, 'i');
+    circuit.set_incremental(true);
+    CHECK(circuit.incremental());
+    CHECK(matches_rebuild(circuit));
+
+    // Edits at the start, middle and end of the circuit
+    circuit.replace_gate(6, {1}, GateLibrary::H());
+    TrigCounters::reset();
+    TrigTensor edited = circuit.matrix();
+    size_t incremental_nproduct = TrigCounters::nproduct();
+    TrigCounters::reset();
+    CHECK(autogate_test::equivalent(edited, rebuilt(circuit).matrix()));
+    CHECK(incremental_nproduct < TrigCounters::nproduct());
+    circuit.remove_gate(3, {1, 2});
+    CHECK(matches_rebuild(circuit));
+    circuit.add_gate(3, {0, 1}, GateLibrary::cRy("incremental_y"));
+    CHECK(matches_rebuild(circuit));
+    circuit.add_gate(100, {0}, GateLibrary::X());
+    CHECK(matches_rebuild(circuit));
+    circuit.remove_gate(0, {0});
+    CHECK(matches_rebuild(circuit));
+    CHECK_THROWS(circuit.remove_gate(0, {0}));
+
+    // Growing and shrinking the qubit count drops every prefix
+    circuit.add_gate(50, {3, 0}, GateLibrary::G("incremental_w"));
+    CHECK(matches_rebuild(circuit));
+    circuit.remove_gate(50, {3, 0});
+    CHECK(matches_rebuild(circuit));
+
+    // Prefixes built without a cutoff are not reused under one
+    {
+        TrigSieve::Scope sieve(1.0E-14);
+        CHECK(autogate_test::equivalent(circuit.matrix(), rebuilt(circuit).matrix(), 1.0E-12));
+    }
+    CHECK(matches_rebuild(circuit));
+
+    // Copies carry the prefixes, and concurrent calls agree
+    Circuit copy = circuit;
+    CHECK(copy.incremental());
+    copy.replace_gate(2, {0}, GateLibrary::X());
+    CHECK(matches_rebuild(copy));
+    CHECK(matches_rebuild(circuit));
+    circuit.replace_gate(4, {2}, GateLibrary::H());
+    TrigTensor expected = rebuilt(circuit).matrix();
+    std::vector<TrigTensor> results(4);
+    std::vector<std::thread> threads;
+    for (size_t index = 0; index < results.size(); index++) {
+        threads.push_back(std::thread([&, index]() { results[index] = circuit.matrix(); }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto const& result : results) {
+        CHECK(autogate_test::equivalent(result, expected));
+    }
+
+    circuit.set_incremental(false);
+    CHECK(matches_rebuild(circuit));
+
+    return autogate_test::report("test_incremental");
+}
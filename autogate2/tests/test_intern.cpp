@@ -0,0 +1,27 @@
+// TrigInternedTensor::gemm against TrigTensor::gemm
+
+#include "test_util.hpp"
+#include "../trig_intern.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    Circuit circuit = autogate_test::brickwork(3, 2, 2);
+    TrigTensor a = circuit.matrix();
+    TrigTensor expected = TrigTensor::gemm(a, a);
+    TrigInternedTensor interned = TrigInternedTensor::from_dense(a);
+    CHECK(interned.nunique() < a.size());
+
+    // The memo bound changes the work done, never the result
+    for (size_t max_memo_terms : {(size_t) TrigInternedTensor::default_max_memo_terms, (size_t) 16, (size_t) 0}) {
+        TrigInternedTensor product = TrigInternedTensor::gemm(interned, interned, max_memo_terms);
+        CHECK(autogate_test::equivalent(product.dense(), expected));
+    }
+
+    // Tensors on different tables
+    TrigInternedTensor other = TrigInternedTensor::from_dense(a);
+    CHECK(autogate_test::equivalent(TrigInternedTensor::gemm(interned, other).dense(), expected));
+
+    return autogate_test::report("test_intern");
+}
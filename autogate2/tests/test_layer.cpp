@@ -0,0 +1,34 @@
+// Circuit layer kernel work counts and results
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    // X on the 2x2 identity: each output entry has one nonzero product
+    Circuit x;
+    x.add_gate(0, {0}, GateLibrary::X());
+    TrigCounters::reset();
+    TrigTensor matrix = x.matrix();
+    CHECK(TrigCounters::nproduct() == 2);
+    CHECK(matrix.data()[1].terms().size() == 1);
+    CHECK(matrix.data()[0].terms().empty());
+
+    // Products with empty operands are skipped, so a layer of Ry on the 4x4
+    // identity does 2 + 4 products per column rather than 8 + 8
+    Circuit ry;
+    ry.add_gate(0, {0}, GateLibrary::Ry('a'));
+    ry.add_gate(0, {1}, GateLibrary::Ry('b'));
+    TrigCounters::reset();
+    ry.matrix();
+    CHECK(TrigCounters::nproduct() == 4 * (2 + 4));
+    CHECK(autogate_test::equivalent(ry.matrix(), autogate_test::reference_matrix(ry)));
+
+    // The fused kernel agrees with gate-by-gate and per-slice products
+    Circuit circuit = autogate_test::brickwork(4, 3, 3);
+    CHECK(autogate_test::equivalent(circuit.matrix(), autogate_test::reference_matrix(circuit)));
+    CHECK(autogate_test::equivalent(circuit.matrix(), circuit.matrix("tree")));
+
+    return autogate_test::report("test_layer");
+}
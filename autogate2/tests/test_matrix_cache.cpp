@@ -0,0 +1,74 @@
+// Circuit::hash and MatrixCache
+
+#include "test_util.hpp"
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace autogate;
+
+// Two-symbol fused gate: its monomials hold both symbols
+static Circuit fused_circuit()
+{
+    Circuit circuit;
+    circuit.add_gate(0, {0}, GateLibrary::Ry("alpha"));
+    circuit.add_gate(1, {0}, GateLibrary::Ry("zeta"));
+    return circuit.fused(1).first;
+}
+
+// fused_circuit().hash() in a fresh process that registers zeta before alpha
+static std::string hash_in_child()
+{
+    int fds[2];
+    if (pipe(fds) != 0) return "";
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        TrigSymbol("zeta");
+        std::string hash = fused_circuit().hash();
+        ssize_t written = write(fds[1], hash.data(), hash.size());
+        _exit(written == (ssize_t) hash.size() ? 0 : 1);
+    }
+    close(fds[1]);
+    char buffer[64];
+    ssize_t size = read(fds[0], buffer, sizeof(buffer));
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+    return size > 0 ? std::string(buffer, size) : "";
+}
+
+int main()
+{
+    // Hash does not depend on symbol registration order
+    std::string child = hash_in_child();
+    TrigSymbol("alpha");
+    CHECK(fused_circuit().hash() == child);
+    CHECK(fused_circuit().hash().size() == 32);
+    CHECK(autogate_test::brickwork(2, 1, 2).hash() != autogate_test::brickwork(2, 1, 1).hash());
+
+    Circuit circuit = autogate_test::brickwork(3, 2, 2);
+    TrigTensor baseline = circuit.matrix();
+
+    // Miss, then hit, with identical results
+    char directory[] = "/tmp/autogate_cache_XXXXXX";
+    CHECK(mkdtemp(directory) != nullptr);
+    MatrixCache::set_directory(directory);
+    MatrixCache::reset_counters();
+    CHECK(autogate_test::equivalent(circuit.matrix(), baseline));
+    CHECK(autogate_test::equivalent(circuit.matrix(), baseline));
+    CHECK(MatrixCache::misses() == 1);
+    CHECK(MatrixCache::hits() == 1);
+    CHECK(MatrixCache::store_failures() == 0);
+    std::string entry = std::string(directory) + "/" + circuit.matrix_key() + ".agt";
+    std::remove(entry.c_str());
+    rmdir(directory);
+
+    // A missing directory is counted, never thrown
+    MatrixCache::set_directory(std::string(directory) + "/missing");
+    MatrixCache::reset_counters();
+    CHECK(autogate_test::equivalent(circuit.matrix(), baseline));
+    CHECK(MatrixCache::store_failures() == 1);
+    MatrixCache::set_directory("");
+    CHECK(!MatrixCache::enabled());
+
+    return autogate_test::report("test_matrix_cache");
+}
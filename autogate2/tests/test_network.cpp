@@ -0,0 +1,66 @@
+// CircuitNetwork amplitudes and blocks against Circuit::matrix
+
+#include "test_util.hpp"
+#include "../circuit_network.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    // Qubits 1 and 3 are untouched
+    Circuit circuit;
+    circuit.add_gate(0, {0}, GateLibrary::Ry("network_a"));
+    circuit.add_gate(0, {2}, GateLibrary::H());
+    circuit.add_gate(1, {0, 2}, GateLibrary::cRy("network_b"));
+    circuit.add_gate(2, {2, 0}, GateLibrary::G("network_c"));
+    circuit.add_gate(3, {0, 2}, GateLibrary::cX());
+    circuit.add_gate(4, {4}, GateLibrary::Ry("network_d"));
+    circuit.add_gate(5, {2, 4}, GateLibrary::cZ());
+    TrigTensor matrix = circuit.matrix();
+    const size_t dim = matrix.shape()[0];
+
+    CircuitNetwork network(circuit);
+    for (size_t x = 0; x < dim; x++) {
+        for (size_t y = 0; y < dim; y++) {
+            CHECK(autogate_test::equivalent(network.amplitude(x, y), matrix.data()[x * dim + y]));
+        }
+    }
+
+    // Blocks over open qubits, with the other qubits fixed by x and y
+    for (auto const& open : std::vector<std::vector<size_t>>{{0}, {2, 0}, {1, 4}, {0, 1, 2, 3, 4}}) {
+        for (size_t x = 0; x < dim; x += 7) {
+            for (size_t y = 0; y < dim; y += 5) {
+                TrigTensor block = network.block(open, x, y);
+                const size_t block_dim = 1ULL << open.size();
+                for (size_t row = 0; row < block_dim; row++) {
+                    for (size_t col = 0; col < block_dim; col++) {
+                        size_t x2 = x, y2 = y;
+                        for (size_t j = 0; j < open.size(); j++) {
+                            x2 = (x2 & ~(1ULL << open[j])) | (((row >> j) & 1ULL) << open[j]);
+                            y2 = (y2 & ~(1ULL << open[j])) | (((col >> j) & 1ULL) << open[j]);
+                        }
+                        CHECK(autogate_test::equivalent(block.data()[row * block_dim + col], matrix.data()[x2 * dim + y2]));
+                    }
+                }
+            }
+        }
+    }
+    CHECK_THROWS(network.block({0, 0}, 0, 0));
+    CHECK_THROWS(network.amplitude(dim, 0));
+
+    // Plans report their largest intermediate, and larger plans are refused
+    ContractionPlan plan = network.plan();
+    CHECK(plan.steps.size() == plan.ntensor - 1);
+    CHECK(plan.max_entries >= 1.0);
+    CHECK(network.max_entries() == CircuitNetwork::default_max_entries);
+    network.set_max_entries(plan.max_entries);
+    CHECK(autogate_test::equivalent(network.amplitude(3, 5), matrix.data()[3 * dim + 5]));
+    network.set_max_entries(plan.max_entries / 2);
+    CHECK_THROWS(network.amplitude(3, 5));
+    CHECK_THROWS(network.set_max_entries(0.0));
+
+    Circuit empty;
+    CHECK(autogate_test::equivalent(CircuitNetwork(empty).amplitude(0, 0), TrigPolynomial::one()));
+
+    return autogate_test::report("test_network");
+}
@@ -0,0 +1,35 @@
+// Circuit::matrix slice orderings against the default "fold"
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    for (size_t nqubit : {1, 3, 4}) {
+        for (size_t depth : {1, 2, 5}) {
+            Circuit circuit = autogate_test::brickwork(nqubit, depth, 3, 'o');
+            TrigTensor fold = circuit.matrix();
+            CHECK(autogate_test::equivalent(circuit.matrix("fold"), fold));
+            CHECK(autogate_test::equivalent(circuit.matrix("tree"), fold));
+            CHECK(autogate_test::equivalent(circuit.matrix("greedy"), fold));
+        }
+    }
+
+    // Parallel tree levels and gemms give the same result as one thread
+    Circuit circuit = autogate_test::brickwork(4, 4, 2, 'o');
+    Parallel::set_num_threads(1);
+    TrigTensor serial = circuit.matrix("tree");
+    Parallel::set_num_threads(4);
+    CHECK(autogate_test::equivalent(circuit.matrix("tree"), serial));
+    CHECK(autogate_test::equivalent(circuit.matrix("greedy"), serial));
+    Parallel::set_num_threads(0);
+
+    // Empty circuits and unknown orderings
+    Circuit empty;
+    CHECK(autogate_test::equivalent(empty.matrix("tree"), empty.matrix()));
+    CHECK(autogate_test::equivalent(empty.matrix("greedy"), empty.matrix()));
+    CHECK_THROWS(circuit.matrix("bogus"));
+
+    return autogate_test::report("test_orderings");
+}
@@ -0,0 +1,76 @@
+// Profiler records against unprofiled runs
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+// Sum of nproduct over records of kind, or of every record if kind is empty
+static size_t nproduct(const std::vector<ProfileRecord>& records, const std::string& kind="")
+{
+    size_t nproduct = 0;
+    for (auto const& record : records) {
+        if (kind.empty() || record.kind == kind) nproduct += record.nproduct;
+    }
+    return nproduct;
+}
+
+int main()
+{
+    Circuit circuit = autogate_test::brickwork(4, 3, 4, 'p');
+    Parallel::set_num_threads(4);
+
+    for (auto const& ordering : {"fold", "tree", "greedy"}) {
+        // Profiling runs the same kernels, so it reproduces the unprofiled
+        // result and work
+        TrigCounters::reset();
+        TrigTensor baseline = circuit.matrix(ordering);
+        size_t expected = TrigCounters::nproduct();
+
+        Profiler::clear();
+        Profiler::set_enabled(true);
+        TrigCounters::reset();
+        TrigTensor profiled = circuit.matrix(ordering);
+        Profiler::set_enabled(false);
+        std::vector<ProfileRecord> records = Profiler::records();
+
+        CHECK(autogate_test::equivalent(profiled, baseline));
+        CHECK(TrigCounters::nproduct() == expected);
+        // Concurrent slices and products are serialized, so the records
+        // account for all of the work exactly once
+        CHECK(nproduct(records) == expected);
+        CHECK(nproduct(records, "layer") > 0);
+        if (std::string(ordering) == "fold") CHECK(nproduct(records, "gemm") == 0);
+        else CHECK(nproduct(records, "gemm") > 0);
+    }
+    TrigTensor baseline = circuit.matrix();
+
+    // A gemm is recorded as one step with all of its work
+    TrigCounters::reset();
+    TrigTensor square = TrigTensor::gemm(baseline, baseline);
+    size_t expected = TrigCounters::nproduct();
+    Profiler::clear();
+    Profiler::set_enabled(true);
+    CHECK(autogate_test::equivalent(TrigTensor::gemm(baseline, baseline), square));
+    Profiler::set_enabled(false);
+    std::vector<ProfileRecord> records = Profiler::records();
+    CHECK(records.size() == 1);
+    CHECK(nproduct(records, "gemm") == expected);
+
+    // One record per fused layer, covering every gate
+    Profiler::clear();
+    Profiler::set_enabled(true);
+    circuit.matrix();
+    Profiler::set_enabled(false);
+    records = Profiler::records();
+    size_t nqubit = 0;
+    for (auto const& record : records) {
+        CHECK(record.kind == "layer");
+        CHECK(record.nentry == 256);
+        nqubit += record.qubits.size();
+    }
+    CHECK(records.size() < circuit.gates().size());
+    CHECK(nqubit == 4 * 3 + 4 + 2 + 4);
+    Parallel::set_num_threads(0);
+
+    return autogate_test::report("test_profiler");
+}
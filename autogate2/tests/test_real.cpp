@@ -0,0 +1,24 @@
+// RealTrigTensor and Circuit::real_matrix against the complex matrix
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    RealTrigTensor empty;
+    CHECK(empty.size() == 0);
+    CHECK(empty.data().empty());
+
+    Circuit circuit = autogate_test::brickwork(3, 3, 2);
+    CHECK(circuit.real());
+    TrigTensor matrix = circuit.matrix();
+    RealTrigTensor real = circuit.real_matrix();
+    CHECK(real.shape() == matrix.shape());
+    CHECK(real.size() == matrix.size());
+    CHECK(RealTrigTensor::is_real(matrix));
+    CHECK(autogate_test::equivalent(real.complex(), matrix));
+    CHECK(autogate_test::equivalent(RealTrigTensor::from_complex(matrix).complex(), matrix));
+
+    return autogate_test::report("test_real");
+}
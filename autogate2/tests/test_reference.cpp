@@ -0,0 +1,56 @@
+// Circuit::matrix, apply and sector_matrix against reference_matrix, which
+// shares no code with the layer kernel
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    // Gates on reversed and non-neighbouring qubits, with an idle qubit
+    Circuit circuit = autogate_test::brickwork(3, 2, 4, 'p');
+    circuit.add_gate(4, {2, 0}, GateLibrary::cRy("reference_t"));
+    circuit.add_gate(5, {0}, GateLibrary::H());
+    circuit.add_gate(5, {2, 1}, GateLibrary::cX());
+    circuit.add_gate(6, {4}, GateLibrary::Ry("reference_u", 2));
+    circuit.add_gate(7, {1, 4}, GateLibrary::G("reference_t"));
+    TrigTensor reference = autogate_test::reference_matrix(circuit);
+    const size_t dim = reference.shape()[0];
+    CHECK(dim == 32);
+
+    CHECK(autogate_test::equivalent(circuit.matrix(), reference));
+
+    TrigTensor identity(std::vector<size_t>{dim, dim});
+    for (size_t index = 0; index < dim; index++) {
+        identity.data()[index*dim + index] = TrigPolynomial::one();
+    }
+    CHECK(autogate_test::equivalent(circuit.apply(identity), reference));
+
+    for (size_t col = 0; col < dim; col += 5) {
+        TrigTensor state = circuit.statevector(col);
+        for (size_t row = 0; row < dim; row++) {
+            CHECK(autogate_test::equivalent(state.data()[row], reference.data()[row * dim + col]));
+        }
+    }
+
+    // Weight-conserving gates in mixed qubit orders
+    Circuit sector;
+    sector.add_gate(0, {0, 1}, GateLibrary::G("reference_a"));
+    sector.add_gate(0, {3, 2}, GateLibrary::G("reference_b"));
+    sector.add_gate(1, {2, 0}, GateLibrary::G("reference_c", 2));
+    sector.add_gate(1, {1}, GateLibrary::Z());
+    sector.add_gate(2, {1, 3}, GateLibrary::cZ());
+    sector.add_gate(3, {3, 0}, GateLibrary::G("reference_a"));
+    reference = autogate_test::reference_matrix(sector);
+    for (size_t weight = 0; weight <= 4; weight++) {
+        std::vector<size_t> states = Circuit::sector_states(4, weight);
+        TrigTensor block = sector.sector_matrix(weight);
+        for (size_t row = 0; row < states.size(); row++) {
+            for (size_t col = 0; col < states.size(); col++) {
+                CHECK(autogate_test::equivalent(block.data()[row * states.size() + col], reference.data()[states[row] * 16 + states[col]]));
+            }
+        }
+    }
+
+    return autogate_test::report("test_reference");
+}
@@ -0,0 +1,39 @@
+// Circuit::sector_matrix against the sector rows and columns of Circuit::matrix
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    // Givens rotations conserve Hamming weight
+    Circuit circuit;
+    for (size_t step = 0; step < 3; step++) {
+        for (size_t qubit = step % 2; qubit + 1 < 4; qubit += 2) {
+            circuit.add_gate(step, {qubit, qubit + 1}, GateLibrary::G((char) ('a' + qubit)));
+        }
+    }
+    circuit.add_gate(3, {0}, GateLibrary::Z());
+    CHECK(circuit.conserves_weight());
+    TrigTensor matrix = circuit.matrix();
+    const size_t dim = matrix.shape()[0];
+
+    std::vector<TrigTensor> blocks = circuit.block_matrix();
+    CHECK(blocks.size() == 5);
+    for (size_t weight = 0; weight <= 4; weight++) {
+        std::vector<size_t> states = Circuit::sector_states(4, weight);
+        const TrigTensor& block = blocks[weight];
+        CHECK(block.shape() == std::vector<size_t>(2, states.size()));
+        for (size_t row = 0; row < states.size(); row++) {
+            for (size_t col = 0; col < states.size(); col++) {
+                CHECK(autogate_test::equivalent(block.data()[row * states.size() + col], matrix.data()[states[row] * dim + states[col]]));
+            }
+        }
+    }
+
+    circuit.add_gate(4, {1}, GateLibrary::X());
+    CHECK(!circuit.conserves_weight());
+    CHECK_THROWS(circuit.sector_matrix(1));
+
+    return autogate_test::report("test_sector");
+}
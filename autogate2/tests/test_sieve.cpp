@@ -0,0 +1,87 @@
+// TrigSieve::Scope pruning and per-call counts
+
+#include "test_util.hpp"
+#include <thread>
+
+using namespace autogate;
+
+static size_t nterm(const TrigTensor& tensor)
+{
+    size_t nterm = 0;
+    for (auto const& poly : tensor.data()) {
+        nterm += poly.terms().size();
+    }
+    return nterm;
+}
+
+// H and Givens rotations leave cancelled terms in the unitary
+static Circuit cancelling_circuit()
+{
+    Circuit circuit;
+    for (size_t step = 0; step < 4; step++) {
+        circuit.add_gate(2 * step, {0}, GateLibrary::H());
+        circuit.add_gate(2 * step, {1}, GateLibrary::Ry('a'));
+        circuit.add_gate(2 * step + 1, {0, 1}, GateLibrary::G('b'));
+    }
+    return circuit;
+}
+
+int main()
+{
+    std::map<TrigMonomial, std::complex<double>> map;
+    map[TrigMonomial()] = 1.0;
+    map[TrigMonomial({std::make_pair('a', 1)})] = 1.0E-18;
+    TrigPolynomial tiny(map);
+    TrigPolynomial one(std::map<TrigMonomial, std::complex<double>>{{TrigMonomial(), 1.0}});
+
+    // No Scope, no pruning
+    CHECK(TrigSieve::current() == nullptr);
+    CHECK(TrigSieve::cutoff() == 0.0);
+    CHECK((tiny * one).terms().size() == 2);
+
+    {
+        TrigSieve::Scope outer(1.0E-12);
+        CHECK((tiny * one).terms().size() == 1);
+        CHECK(outer.npruned() == 1);
+        {
+            // The innermost Scope applies and keeps its own count
+            TrigSieve::Scope inner(0.0);
+            CHECK((tiny * one).terms().size() == 2);
+            CHECK(inner.npruned() == 0);
+        }
+        CHECK(TrigSieve::cutoff() == 1.0E-12);
+
+        // Other threads are unaffected
+        size_t other_terms = 0;
+        std::thread other([&]() { other_terms = (tiny * one).terms().size(); });
+        other.join();
+        CHECK(other_terms == 2);
+        CHECK(outer.npruned() == 1);
+    }
+    CHECK(TrigSieve::current() == nullptr);
+    CHECK_THROWS(TrigSieve::Scope(-1.0));
+
+    // Pruned circuit matrices agree with the baseline, and every ordering and
+    // thread count reports the count of its own call
+    Circuit circuit = cancelling_circuit();
+    TrigTensor baseline = circuit.matrix();
+    size_t expected = 0;
+    for (int nthread : {1, 4}) {
+        Parallel::set_num_threads(nthread);
+        TrigSieve::Scope sieve(1.0E-14);
+        TrigTensor pruned = circuit.matrix();
+        CHECK(autogate_test::equivalent(pruned, baseline, 1.0E-12));
+        CHECK(nterm(pruned) < nterm(baseline));
+        CHECK(sieve.npruned() > 0);
+        if (nthread == 1) expected = sieve.npruned();
+        CHECK(sieve.npruned() == expected);
+    }
+    for (auto const& ordering : {"tree", "greedy"}) {
+        TrigSieve::Scope sieve(1.0E-14);
+        CHECK(autogate_test::equivalent(circuit.matrix(ordering), baseline, 1.0E-12));
+        CHECK(sieve.npruned() > 0);
+    }
+    Parallel::set_num_threads(0);
+
+    return autogate_test::report("test_sieve");
+}
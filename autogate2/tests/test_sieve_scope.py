@@ -0,0 +1,62 @@
+# TrigSieve.Scope used from Python (make test-python, needs the plugin). A
+# scope exited out of order or from another thread must raise instead of
+# leaving the thread's current scope pointing at a closed one.
+
+import sys
+import threading
+
+import autogate2
+
+def test_nested():
+    outer = autogate2.TrigSieve.Scope(1.0E-12)
+    inner = autogate2.TrigSieve.Scope(0.0)
+    with outer:
+        assert autogate2.TrigSieve.cutoff() == 1.0E-12
+        with inner:
+            assert autogate2.TrigSieve.cutoff() == 0.0
+        assert autogate2.TrigSieve.cutoff() == 1.0E-12
+    assert autogate2.TrigSieve.cutoff() == 0.0
+
+def test_out_of_order_exit():
+    a = autogate2.TrigSieve.Scope(1.0E-12)
+    b = autogate2.TrigSieve.Scope(0.0)
+    a.__enter__()
+    b.__enter__()
+    try:
+        a.__exit__(None, None, None)
+        assert False, 'exiting a before b did not raise'
+    except RuntimeError:
+        pass
+    assert autogate2.TrigSieve.cutoff() == 0.0
+    b.__exit__(None, None, None)
+    assert autogate2.TrigSieve.cutoff() == 1.0E-12
+    a.__exit__(None, None, None)
+    assert autogate2.TrigSieve.cutoff() == 0.0
+
+def test_other_thread_exit():
+    scope = autogate2.TrigSieve.Scope(1.0E-12)
+    scope.__enter__()
+    errors = []
+    def exit_scope():
+        try:
+            scope.__exit__(None, None, None)
+        except RuntimeError as error:
+            errors.append(error)
+    thread = threading.Thread(target=exit_scope)
+    thread.start()
+    thread.join()
+    assert len(errors) == 1
+    assert autogate2.TrigSieve.cutoff() == 1.0E-12
+    scope.__exit__(None, None, None)
+    assert autogate2.TrigSieve.cutoff() == 0.0
+
+if __name__ == '__main__':
+    nfailure = 0
+    for test in [test_nested, test_out_of_order_exit, test_other_thread_exit]:
+        try:
+            test()
+        except AssertionError as error:
+            print('%s: check failed: %s' % (test.__name__, error))
+            nfailure += 1
+    print('test_sieve_scope: %s' % ('FAILED' if nfailure else 'passed'))
+    sys.exit(1 if nfailure else 0)
@@ -0,0 +1,24 @@
+// TrigSparseTensor and Circuit::sparse_matrix against dense products
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    Circuit circuit = autogate_test::brickwork(3, 3, 2, 's');
+    TrigTensor a = circuit.matrix();
+    TrigTensor b = autogate_test::brickwork(3, 2, 3, 'v').matrix();
+    TrigTensor expected = TrigTensor::gemm(a, b);
+
+    TrigSparseTensor sparse_a = TrigSparseTensor::from_dense(a);
+    TrigSparseTensor sparse_b = TrigSparseTensor::from_dense(b);
+    CHECK(sparse_a.nnz() <= a.size());
+    CHECK(autogate_test::equivalent(sparse_a.dense(), a));
+    CHECK(autogate_test::equivalent(TrigSparseTensor::gemm(sparse_a, b), expected));
+    CHECK(autogate_test::equivalent(TrigSparseTensor::gemm(a, sparse_b), expected));
+    CHECK(autogate_test::equivalent(TrigSparseTensor::gemm(sparse_a, sparse_b).dense(), expected));
+    CHECK(autogate_test::equivalent(circuit.sparse_matrix().dense(), a));
+
+    return autogate_test::report("test_sparse");
+}
@@ -0,0 +1,36 @@
+// Circuit::apply and Circuit::statevector against columns of Circuit::matrix
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+int main()
+{
+    Circuit circuit = autogate_test::brickwork(3, 3, 2);
+    TrigTensor matrix = circuit.matrix();
+    const size_t dim = matrix.shape()[0];
+
+    for (size_t col = 0; col < dim; col++) {
+        TrigTensor state = circuit.statevector(col);
+        CHECK(state.shape() == std::vector<size_t>{dim});
+        for (size_t row = 0; row < dim; row++) {
+            CHECK(autogate_test::equivalent(state.data()[row], matrix.data()[row * dim + col]));
+        }
+    }
+
+    // Bitstrings are in qiskit order: the last character is qubit 0
+    CHECK(autogate_test::equivalent(circuit.statevector("001"), circuit.statevector(1)));
+    CHECK(autogate_test::equivalent(circuit.statevector("110"), circuit.statevector(6)));
+    CHECK_THROWS(circuit.statevector("01"));
+    CHECK_THROWS(circuit.statevector("0a1"));
+    CHECK_THROWS(circuit.statevector(dim));
+
+    // Applied to the identity, U is the matrix
+    TrigTensor identity(std::vector<size_t>{dim, dim});
+    for (size_t index = 0; index < dim; index++) {
+        identity.data()[index * dim + index] = TrigPolynomial::one();
+    }
+    CHECK(autogate_test::equivalent(circuit.apply(identity), matrix));
+
+    return autogate_test::report("test_statevector");
+}
@@ -0,0 +1,157 @@
+// TrigMonomial and TrigPolynomial arithmetic against the std::map semantics
+// of the original implementation, with interleaved and cancelling symbols
+
+#include "test_util.hpp"
+
+using namespace autogate;
+
+typedef std::map<char, int> reference_monomial_t;
+typedef std::map<reference_monomial_t, std::complex<double>> reference_polynomial_t;
+
+TrigMonomial monomial(const reference_monomial_t& reference)
+{
+    typedef decltype(TrigMonomial().variables()) variables_t;
+    variables_t variables;
+    for (auto const& variable : reference) {
+        variables.push_back(variables_t::value_type(variable.first, variable.second));
+    }
+    return TrigMonomial(variables);
+}
+
+TrigPolynomial polynomial(const reference_polynomial_t& reference)
+{
+    std::map<TrigMonomial, std::complex<double>> terms;
+    for (auto const& term : reference) {
+        terms[monomial(term.first)] = term.second;
+    }
+    return TrigPolynomial(terms);
+}
+
+reference_monomial_t multiply(const reference_monomial_t& a, const reference_monomial_t& b)
+{
+    reference_monomial_t product = a;
+    for (auto const& variable : b) {
+        if ((product[variable.first] += variable.second) == 0) product.erase(variable.first);
+    }
+    return product;
+}
+
+// Same keys (zero coefficients included, as std::map kept them) and values
+bool same(const TrigPolynomial& poly, const reference_polynomial_t& reference)
+{
+    std::map<TrigMonomial, std::complex<double>> expected;
+    for (auto const& term : reference) {
+        expected[monomial(term.first)] = term.second;
+    }
+    std::map<TrigMonomial, std::complex<double>> terms = poly.polynomial();
+    if (terms.size() != expected.size()) return false;
+    auto it = expected.begin();
+    for (auto const& term : terms) {
+        if (term.first != it->first || std::abs(term.second - it->second) > 1.0E-14) return false;
+        ++it;
+    }
+    return true;
+}
+
+size_t random(size_t n)
+{
+    static uint64_t state = 0x2545F4914F6CDD1DULL;
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (state >> 33) % n;
+}
+
+reference_polynomial_t random_polynomial(size_t nterm)
+{
+    reference_polynomial_t poly;
+    for (size_t term = 0; term < nterm; term++) {
+        reference_monomial_t mono;
+        for (char symbol = 'a'; symbol <= 'h'; symbol++) {
+            int order = (int) random(5) - 2;
+            if (order) mono[symbol] = order;
+        }
+        poly[mono] += std::complex<double>((double) random(7) - 3.0, (double) random(3));
+    }
+    return poly;
+}
+
+void check_monomials()
+{
+    // Interleaved symbols, in both operand orders
+    TrigMonomial ac = monomial({{'a', 1}, {'c', 2}});
+    TrigMonomial bd = monomial({{'b', -1}, {'d', 3}});
+    TrigMonomial abcd = monomial({{'a', 1}, {'b', -1}, {'c', 2}, {'d', 3}});
+    CHECK(ac * bd == abcd);
+    CHECK(bd * ac == abcd);
+
+    // Shared symbols whose orders cancel
+    CHECK(monomial({{'a', 1}, {'b', 2}, {'c', 3}}) * monomial({{'a', -1}, {'c', -3}}) == monomial({{'b', 2}}));
+    CHECK(monomial({{'b', 1}, {'d', 1}}) * monomial({{'a', 1}, {'b', -1}, {'c', 2}, {'d', -1}}) == monomial({{'a', 1}, {'c', 2}}));
+    CHECK(monomial({{'a', 1}}) * monomial({{'a', -1}}) == TrigMonomial::one());
+    CHECK(abcd * abcd.conj() == TrigMonomial::one());
+    CHECK(monomial({{'a', 1}, {'c', -1}}) * monomial({{'b', 1}, {'c', 2}, {'e', 1}}) == monomial({{'a', 1}, {'b', 1}, {'c', 1}, {'e', 1}}));
+
+    // Products past the inline capacity, with and without an open arena
+    reference_monomial_t even, odd, all;
+    for (char symbol = 'a'; symbol < 'a' + 16; symbol++) {
+        ((symbol - 'a') % 2 ? odd : even)[symbol] = symbol - 'a' + 1;
+        all[symbol] = symbol - 'a' + 1;
+    }
+    CHECK(monomial(even) * monomial(odd) == monomial(all));
+    {
+        TrigArena::Scope arena_scope;
+        CHECK(monomial(odd) * monomial(even) == monomial(all));
+        CHECK(monomial(all) * monomial(even).conj() == monomial(odd));
+    }
+
+    for (size_t trial = 0; trial < 200; trial++) {
+        reference_monomial_t a = random_polynomial(1).begin()->first;
+        reference_monomial_t b = random_polynomial(1).begin()->first;
+        CHECK(monomial(a) * monomial(b) == monomial(multiply(a, b)));
+    }
+}
+
+void check_polynomials()
+{
+    for (size_t trial = 0; trial < 50; trial++) {
+        reference_polynomial_t a = random_polynomial(1 + random(12));
+        reference_polynomial_t b = random_polynomial(1 + random(12));
+        // Share some monomials so that sums and products combine terms
+        for (auto const& term : a) {
+            if (random(3) == 0) b[term.first] -= term.second;
+        }
+
+        reference_polynomial_t sum = a, difference = a, product;
+        for (auto const& term : b) {
+            sum[term.first] += term.second;
+            difference[term.first] -= term.second;
+        }
+        for (auto const& terma : a) {
+            for (auto const& termb : b) {
+                product[multiply(terma.first, termb.first)] += terma.second * termb.second;
+            }
+        }
+
+        TrigPolynomial polya = polynomial(a), polyb = polynomial(b);
+        CHECK(same(polya + polyb, sum));
+        CHECK(same(polya - polyb, difference));
+        CHECK(same(polya * polyb, product));
+        TrigPolynomial accumulated = polya;
+        accumulated += polyb;
+        CHECK(same(accumulated, sum));
+        accumulated -= polyb;
+        accumulated -= polyb;
+        CHECK(same(accumulated, difference));
+    }
+
+    // Cancellation keeps the zero term, as std::map accumulation did
+    TrigPolynomial cos = TrigPolynomial::cos('a');
+    CHECK(same(cos - cos, {{{{'a', -1}}, 0.0}, {{{'a', 1}}, 0.0}}));
+    CHECK(same(TrigPolynomial::zero() + TrigPolynomial::one(), {{{}, 1.0}}));
+}
+
+int main()
+{
+    check_monomials();
+    check_polynomials();
+    return autogate_test::report("test_trig");
+}
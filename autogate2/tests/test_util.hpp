@@ -0,0 +1,125 @@
+#pragma once
+
+// Minimal checks shared by the regression tests (make test). Each test is a
+// standalone program that prints its failures and exits nonzero if any check
+// failed. reference_matrix() rebuilds the unitary the way the original
+// Circuit::matrix() did, independently of the circuit kernels, so that tests
+// can check those kernels against it.
+
+#include "../trig.hpp"
+#include "../circuit.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace autogate_test {
+
+inline int& nfailure() { static int nfailure = 0; return nfailure; }
+
+inline void check(bool condition, const char* text, const char* file, int line)
+{
+    if (condition) return;
+    std::printf("%s:%d: check failed: %s\n", file, line, text);
+    nfailure()++;
+}
+
+#define CHECK(condition) autogate_test::check((condition), #condition, __FILE__, __LINE__)
+
+#define CHECK_THROWS(statement) \
+    do { \
+        bool thrown = false; \
+        try { statement; } catch (const std::runtime_error&) { thrown = true; } \
+        autogate_test::check(thrown, #statement " throws", __FILE__, __LINE__); \
+    } while (0)
+
+inline int report(const char* name)
+{
+    std::printf("%s: %s\n", name, nfailure() ? "FAILED" : "passed");
+    return nfailure() ? 1 : 0;
+}
+
+inline bool equivalent(const autogate::TrigPolynomial& a, const autogate::TrigPolynomial& b, double tolerance=1.0E-10)
+{
+    autogate::TrigPolynomial difference = a - b;
+    for (auto const& term : difference.terms()) {
+        if (std::abs(term.second) > tolerance) return false;
+    }
+    return true;
+}
+
+inline bool equivalent(const autogate::TrigTensor& a, const autogate::TrigTensor& b, double tolerance=1.0E-10)
+{
+    if (a.shape() != b.shape()) return false;
+    for (size_t index = 0; index < a.data().size(); index++) {
+        if (!equivalent(a.data()[index], b.data()[index], tolerance)) return false;
+    }
+    return true;
+}
+
+// The circuit unitary built by embedding each gate into a 2^nqubit x 2^nqubit
+// operator and folding the operators together with TrigTensor::gemm
+inline autogate::TrigTensor reference_matrix(const autogate::Circuit& circuit)
+{
+    size_t nqubit = circuit.nqubit();
+    size_t dim = 1ULL<<nqubit;
+    std::vector<size_t> shape = {dim, dim};
+    autogate::TrigTensor mat(shape);
+    for (size_t index = 0; index < dim; index++) {
+        mat.data()[index*dim + index] = autogate::TrigPolynomial::one();
+    }
+
+    for (auto const& gate : circuit.gates()) {
+        const std::vector<size_t>& qubits = gate.first.second;
+        const autogate::TrigTensor& gate_op = gate.second.matrix();
+        size_t gate_dim = gate_op.shape()[0];
+
+        // Bits of the qubits the gate does not act on
+        std::vector<size_t> others;
+        for (size_t qubit = 0; qubit < nqubit; qubit++) {
+            if (std::find(qubits.begin(), qubits.end(), qubit) == qubits.end()) others.push_back(qubit);
+        }
+
+        // Gate-local index bit q is qubit qubits[q] of the full index
+        auto embed = [&qubits](size_t local) {
+            size_t index = 0;
+            for (size_t q = 0; q < qubits.size(); q++) {
+                if (local & (1ULL<<q)) index |= 1ULL<<qubits[q];
+            }
+            return index;
+        };
+
+        autogate::TrigTensor mat2(shape);
+        for (size_t k = 0; k < (1ULL<<others.size()); k++) {
+            size_t base = 0;
+            for (size_t o = 0; o < others.size(); o++) {
+                if (k & (1ULL<<o)) base |= 1ULL<<others[o];
+            }
+            for (size_t l = 0; l < gate_dim; l++) {
+                for (size_t m = 0; m < gate_dim; m++) {
+                    mat2.data()[(base + embed(l)) * dim + (base + embed(m))] = gate_op.data()[l * gate_dim + m];
+                }
+            }
+        }
+        mat = autogate::TrigTensor::gemm(mat2, mat);
+    }
+    return mat;
+}
+
+// Layers of Ry on every qubit alternating with cX on neighbouring pairs, with
+// nsymbol distinct symbols first, first + 1, ...
+inline autogate::Circuit brickwork(size_t nqubit, size_t depth, size_t nsymbol, char first='a')
+{
+    autogate::Circuit circuit;
+    size_t ngate = 0;
+    for (size_t step = 0; step < depth; step++) {
+        for (size_t qubit = 0; qubit < nqubit; qubit++) {
+            circuit.add_gate(2 * step, {qubit}, autogate::GateLibrary::Ry((char) (first + ngate++ % nsymbol)));
+        }
+        for (size_t qubit = step % 2; qubit + 1 < nqubit; qubit += 2) {
+            circuit.add_gate(2 * step + 1, {qubit, qubit + 1}, autogate::GateLibrary::cX());
+        }
+    }
+    return circuit;
+}
+
+} // namespace autogate_test
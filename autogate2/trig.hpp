@@ -6,6 +6,12 @@
 #include <map>
 #include <complex>
 #include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <functional>
+#include <atomic>
+#include "trig_arena.hpp"
+#include "trig_symbol.hpp"
 
 namespace autogate {
 
@@ -13,92 +19,519 @@ class TrigMonomial {
 
 public:
 
+// A variable (symbol, order) packed into one word: the TrigSymbol id in the high 32
+// bits and the order, biased by 2^31, in the low 32 bits. Packed words compare in
+// the same order as the (symbol, order) pairs they encode.
+typedef uint64_t word_t;
+
+static word_t pack(uint32_t symbol, int order) { return (((word_t) symbol) << 32) | (word_t) (((uint32_t) order) ^ 0x80000000U); }
+static uint32_t symbol(word_t word) { return (uint32_t) (word >> 32); }
+static int order(word_t word) { return (int) (((uint32_t) word) ^ 0x80000000U); }
+
+// Monomials with up to inline_capacity variables are stored without allocation.
+// Larger temporaries (multiply_temporary, from_words) formed while a
+// TrigArena::Scope is open spill into the arena; everything else uses the heap.
+static const size_t inline_capacity = 6;
+
+TrigMonomial() : size_(0), arena_capacity_(0), heap_(nullptr) {}
+
 TrigMonomial(
-    const std::vector<std::pair<char, int>>& variables) :
-    variables_(variables)
+    const std::vector<std::pair<TrigSymbol, int>>& variables) :
+    size_(0),
+    arena_capacity_(0),
+    heap_(nullptr)
 {
-    if (!std::is_sorted(variables_.begin(), variables_.end())) throw std::runtime_error("variables must be sorted");
+    if (!std::is_sorted(variables.begin(), variables.end())) throw std::runtime_error("variables must be sorted");
     for (auto variable : variables) {
         if (std::get<1>(variable) == 0) throw std::runtime_error("zero order not permitted");
     }
-    for (ssize_t index = 0; index < ((ssize_t) variables_.size()) - 1; index++) {
-        if (std::get<0>(variables_[index]) == std::get<0>(variables_[index+1])) throw std::runtime_error("duplicate symbols not permitted");
+    for (ssize_t index = 0; index < ((ssize_t) variables.size()) - 1; index++) {
+        if (std::get<0>(variables[index]) == std::get<0>(variables[index+1])) throw std::runtime_error("duplicate symbols not permitted");
+    }
+    word_t* words = allocate(variables.size());
+    for (auto variable : variables) {
+        words[size_++] = pack(std::get<0>(variable).id(), std::get<1>(variable));
+    }
+}
+
+TrigMonomial(const TrigMonomial& other) :
+    size_(0),
+    arena_capacity_(0),
+    heap_(nullptr)
+{
+    word_t* words = allocate(other.size_);
+    std::copy(other.begin(), other.end(), words);
+    size_ = other.size_;
+}
+
+TrigMonomial(TrigMonomial&& other) :
+    size_(other.size_),
+    arena_capacity_(other.arena_capacity_),
+    heap_(other.heap_)
+{
+    if (!heap_) std::copy(other.inline_, other.inline_ + size_, inline_);
+    other.size_ = 0;
+    other.arena_capacity_ = 0;
+    other.heap_ = nullptr;
+}
+
+TrigMonomial& operator=(const TrigMonomial& other)
+{
+    if (this != &other) {
+        TrigMonomial copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+TrigMonomial& operator=(TrigMonomial&& other)
+{
+    if (this != &other) {
+        deallocate();
+        size_ = other.size_;
+        arena_capacity_ = other.arena_capacity_;
+        heap_ = other.heap_;
+        if (!heap_) std::copy(other.inline_, other.inline_ + size_, inline_);
+        other.size_ = 0;
+        other.arena_capacity_ = 0;
+        other.heap_ = nullptr;
     }
+    return *this;
 }
 
-const std::vector<std::pair<char, int>>& variables() const { return variables_; }
+~TrigMonomial() { deallocate(); }
+
+size_t size() const { return size_; }
+
+// Order of symbol in this monomial (0 if absent)
+int order_of(const TrigSymbol& symbol) const
+{
+    uint32_t symbol2 = symbol.id();
+    const word_t* word = std::lower_bound(begin(), end(), pack(symbol2, std::numeric_limits<int>::min()));
+    return (word != end() && TrigMonomial::symbol(*word) == symbol2) ? order(*word) : 0;
+}
+// Monomial from packed words, which must be sorted by symbol with no repeated
+// symbols. Temporaries may be backed by the current TrigArena.
+static TrigMonomial from_words(const word_t* begin, const word_t* end, bool temporary=false)
+{
+    TrigMonomial monomial;
+    word_t* words = monomial.allocate(end - begin, temporary);
+    std::copy(begin, end, words);
+    monomial.size_ = end - begin;
+    return monomial;
+}
+
+// True if the variables live in a TrigArena and must be copied before the arena is released
+bool temporary() const { return arena_capacity_ != 0; }
+const word_t* begin() const { return heap_ ? heap_ : inline_; }
+const word_t* end() const { return begin() + size_; }
+
+std::vector<std::pair<TrigSymbol, int>> variables() const
+{
+    std::vector<std::pair<TrigSymbol, int>> variables;
+    for (const word_t* word = begin(); word != end(); ++word) {
+        variables.push_back(std::pair<TrigSymbol, int>(TrigSymbol::from_id(symbol(*word)), order(*word)));
+    }
+    return variables;
+}
+
+size_t hash() const
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ size_;
+    for (const word_t* word = begin(); word != end(); ++word) {
+        hash ^= *word + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    }
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return (size_t) hash;
+}
 
 static
-TrigMonomial one() { return TrigMonomial({}); }
+TrigMonomial one() { return TrigMonomial(); }
 
-friend bool operator<(const TrigMonomial& a, const TrigMonomial& b) { return a.variables() < b.variables(); }
-friend bool operator>(const TrigMonomial& a, const TrigMonomial& b) { return a.variables() > b.variables(); }
-friend bool operator<=(const TrigMonomial& a, const TrigMonomial& b) { return a.variables() <= b.variables(); }
-friend bool operator>=(const TrigMonomial& a, const TrigMonomial& b) { return a.variables() >= b.variables(); }
-friend bool operator==(const TrigMonomial& a, const TrigMonomial& b) { return a.variables() == b.variables(); }
-friend bool operator!=(const TrigMonomial& a, const TrigMonomial& b) { return a.variables() != b.variables(); }
+friend bool operator<(const TrigMonomial& a, const TrigMonomial& b) { return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end()); }
+friend bool operator>(const TrigMonomial& a, const TrigMonomial& b) { return b < a; }
+friend bool operator<=(const TrigMonomial& a, const TrigMonomial& b) { return !(b < a); }
+friend bool operator>=(const TrigMonomial& a, const TrigMonomial& b) { return !(a < b); }
+friend bool operator==(const TrigMonomial& a, const TrigMonomial& b) { return a.size_ == b.size_ && std::equal(a.begin(), a.end(), b.begin()); }
+friend bool operator!=(const TrigMonomial& a, const TrigMonomial& b) { return !(a == b); }
 
 TrigMonomial conj() const 
 { 
-    std::vector<std::pair<char, int>> variables(variables_.size()); 
-    for (size_t index = 0; index < variables_.size(); index++) {
-        variables[index] = std::pair<char, int>(std::get<0>(variables_[index]), -std::get<1>(variables_[index]));
+    TrigMonomial monomial;
+    word_t* words = monomial.allocate(size_);
+    for (const word_t* word = begin(); word != end(); ++word) {
+        words[monomial.size_++] = pack(symbol(*word), -order(*word));
     }
-    return TrigMonomial(variables);
+    return monomial;
 }
 
-friend TrigMonomial operator*(const TrigMonomial& a, const TrigMonomial& b) 
+friend TrigMonomial operator*(const TrigMonomial& a, const TrigMonomial& b) { return multiply(a, b, false); }
+
+// a * b, backed by the current TrigArena if it spills past inline_capacity.
+// The product must be copied out before the arena's Scope closes.
+static TrigMonomial multiply_temporary(const TrigMonomial& a, const TrigMonomial& b) { return multiply(a, b, true); }
+
+private:
+
+static TrigMonomial multiply(const TrigMonomial& a, const TrigMonomial& b, bool temporary)
 {
-    std::vector<std::pair<char, int>> variables; 
-    size_t indexa = 0;
-    size_t indexb = 0;
-    for (; indexa < a.variables().size() && indexb < b.variables().size();) {
-        char symbola = std::get<0>(a.variables()[indexa]);
-        char symbolb = std::get<0>(b.variables()[indexb]);
-        int ordera = std::get<1>(a.variables()[indexa]);
-        int orderb = std::get<1>(b.variables()[indexb]);
+    TrigMonomial monomial;
+    word_t* words = monomial.allocate(a.size_ + b.size_, temporary);
+    const word_t* itera = a.begin();
+    const word_t* iterb = b.begin();
+    size_t size = 0;
+    while (itera != a.end() && iterb != b.end()) {
+        uint32_t symbola = symbol(*itera);
+        uint32_t symbolb = symbol(*iterb);
         if (symbola < symbolb) {
-            variables.push_back(std::pair<char, int>(symbola, ordera));
-            indexa++;
-        } else if (symbolb > symbola) {
-            variables.push_back(std::pair<char, int>(symbolb, orderb));
-            indexb++;
+            words[size++] = *itera++;
+        } else if (symbolb < symbola) {
+            words[size++] = *iterb++;
         } else {
-            if (ordera + orderb != 0) {
-                variables.push_back(std::pair<char, int>(symbola, ordera + orderb));
+            int order2 = order(*itera++) + order(*iterb++);
+            if (order2 != 0) {
+                words[size++] = pack(symbola, order2);
             }
-            indexa++;
-            indexb++;
         }
     }
-    for (; indexa < a.variables().size(); indexa++) {
-        variables.push_back(a.variables()[indexa]);
+    size = std::copy(itera, a.end(), words + size) - words;
+    size = std::copy(iterb, b.end(), words + size) - words;
+    monomial.size_ = size;
+    return monomial;
+}
+
+uint32_t size_;
+uint32_t arena_capacity_;
+word_t* heap_;
+word_t inline_[inline_capacity];
+
+// Returns storage for capacity words, spilling to the heap beyond inline_capacity
+// (or to the current arena for temporaries). Arena storage is preceded by a
+// header word holding the owning arena, so that a monomial moved to another
+// thread is still returned to the arena that allocated it.
+word_t* allocate(size_t capacity, bool temporary=false)
+{
+    if (capacity <= inline_capacity) return inline_;
+    TrigArena* arena = temporary ? TrigArena::current() : nullptr;
+    if (arena) {
+        word_t* block = static_cast<word_t*>(arena->allocate((capacity + 1) * sizeof(word_t)));
+        block[0] = (word_t) reinterpret_cast<uintptr_t>(arena);
+        heap_ = block + 1;
+        arena_capacity_ = capacity;
+    } else {
+        heap_ = new word_t[capacity];
+    }
+    return heap_;
+}
+
+void deallocate()
+{
+    if (!arena_capacity_) {
+        delete[] heap_;
+    } else {
+        TrigArena* arena = reinterpret_cast<TrigArena*>((uintptr_t) heap_[-1]);
+        arena->deallocate(heap_ - 1, (arena_capacity_ + 1) * sizeof(word_t));
+    }
+}
+
+};
+
+typedef std::pair<TrigMonomial, std::complex<double>> trig_term_t;
+
+// Cutoff applied by the accumulators of the calling thread when they emit
+// terms, so that cancelled terms (coefficients around 1E-17) are dropped inside
+// operator*, gemm and the circuit kernels instead of bloating every later
+// product. Pruning only happens inside a TrigSieve::Scope; without one the
+// cutoff is 0 and nothing is dropped.
+class TrigSieve {
+
+public:
+
+// Sets the cutoff for the calling thread until it closes, and counts the terms
+// pruned under it. Scopes nest; the innermost one applies. Parallel kernels
+// open a worker Scope on each thread with the caller's Scope as parent, which
+// shares its cutoff and adds its count to the parent when it closes.
+class Scope {
+public:
+explicit Scope(double cutoff) :
+    cutoff_(checked(cutoff)),
+    npruned_(0),
+    parent_(nullptr),
+    previous_(current())
+{
+    current_setting() = this;
+}
+
+explicit Scope(Scope* parent) :
+    cutoff_(parent ? parent->cutoff_ : 0.0),
+    npruned_(0),
+    parent_(parent),
+    previous_(current())
+{
+    current_setting() = this;
+}
+
+~Scope()
+{
+    current_setting() = previous_;
+    if (parent_) parent_->npruned_.fetch_add(npruned_.load(), std::memory_order_relaxed);
+}
+
+Scope(const Scope&) = delete;
+Scope& operator=(const Scope&) = delete;
+
+double cutoff() const { return cutoff_; }
+
+// Terms pruned under this Scope so far, including closed worker Scopes
+size_t npruned() const { return npruned_.load(); }
+
+void add_npruned(size_t npruned) { npruned_.fetch_add(npruned, std::memory_order_relaxed); }
+
+private:
+double cutoff_;
+std::atomic<size_t> npruned_;
+Scope* parent_;
+Scope* previous_;
+
+static double checked(double cutoff)
+{
+    if (cutoff < 0.0) throw std::runtime_error("cutoff must be >= 0");
+    return cutoff;
+}
+};
+
+// The innermost Scope open on the calling thread, or nullptr
+static Scope* current() { return current_setting(); }
+
+// The calling thread's cutoff (0 outside any Scope)
+static double cutoff() { Scope* scope = current(); return scope ? scope->cutoff() : 0.0; }
+
+private:
+
+static Scope*& current_setting() { static thread_local Scope* scope = nullptr; return scope; }
+
+};
+
+// Process-wide work counters fed by every BasicTrigAccumulator: polynomial
+// products, term multiplies, emitted entries and their terms, and the largest
+// entry emitted. Accumulators count locally and flush here when they are
+// destroyed (or explicitly), so the hot loops touch no shared state.
+class TrigCounters {
+
+public:
+
+static size_t nproduct() { return counter(0).load(); }
+static size_t nmultiply() { return counter(1).load(); }
+static size_t nentry() { return counter(2).load(); }
+static size_t nterm() { return counter(3).load(); }
+static size_t max_entry_terms() { return counter(4).load(); }
+
+static void reset()
+{
+    for (int index = 0; index < 5; index++) {
+        counter(index).store(0);
+    }
+}
+
+static void add(size_t nproduct, size_t nmultiply, size_t nentry, size_t nterm, size_t max_entry_terms)
+{
+    counter(0).fetch_add(nproduct, std::memory_order_relaxed);
+    counter(1).fetch_add(nmultiply, std::memory_order_relaxed);
+    counter(2).fetch_add(nentry, std::memory_order_relaxed);
+    counter(3).fetch_add(nterm, std::memory_order_relaxed);
+    std::atomic<size_t>& peak = counter(4);
+    size_t current = peak.load(std::memory_order_relaxed);
+    while (current < max_entry_terms && !peak.compare_exchange_weak(current, max_entry_terms, std::memory_order_relaxed)) {}
+}
+
+private:
+
+static std::atomic<size_t>& counter(int index) { static std::atomic<size_t> counters[5]; return counters[index]; }
+
+};
+
+// Open-addressing hash accumulator for polynomial terms. Terms are summed in
+// insertion order and compacted to a sorted term vector by terms(), so results
+// do not depend on the hash layout. The table keeps its capacity across clear()
+// so that repeated accumulations do not allocate per term.
+template <typename Coefficient>
+class BasicTrigAccumulator {
+
+public:
+
+typedef std::pair<TrigMonomial, Coefficient> term_t;
+
+BasicTrigAccumulator() :
+    nproduct_(0),
+    nmultiply_(0),
+    nentry_(0),
+    nterm_(0),
+    max_entry_terms_(0)
+{
+}
+
+~BasicTrigAccumulator() { flush(); }
+
+size_t size() const { return terms_.size(); }
+
+// Moves the local work counts into TrigCounters
+void flush()
+{
+    if (!nproduct_ && !nentry_) return;
+    TrigCounters::add(nproduct_, nmultiply_, nentry_, nterm_, max_entry_terms_);
+    nproduct_ = nmultiply_ = nentry_ = nterm_ = max_entry_terms_ = 0;
+}
+
+template <typename Monomial>
+void add(Monomial&& monomial, const Coefficient& coefficient)
+{
+    size_t slot = find(monomial, monomial.hash());
+    if (slots_[slot] == empty) {
+        slots_[slot] = terms_.size();
+        used_.push_back(slot);
+        terms_.push_back(term_t(std::forward<Monomial>(monomial), coefficient));
+        if (2 * terms_.size() > slots_.size()) rehash(2 * slots_.size());
+    } else {
+        terms_[slots_[slot]].second += coefficient;
+    }
+}
+
+void add(const std::vector<term_t>& terms)
+{
+    for (auto const& term : terms) {
+        add(term.first, term.second);
+    }
+}
+
+void add_product(const std::vector<term_t>& a, const std::vector<term_t>& b)
+{
+    nproduct_++;
+    nmultiply_ += a.size() * b.size();
+    for (auto const& terma : a) {
+        for (auto const& termb : b) {
+            add(TrigMonomial::multiply_temporary(terma.first, termb.first), terma.second * termb.second);
+        }
+    }
+}
+
+// Returns the accumulated terms sorted by monomial and clears the accumulator.
+// Terms with |coefficient| <= TrigSieve::cutoff() are dropped and counted in
+// the calling thread's TrigSieve::Scope. Arena-backed monomials are copied out
+// so that the result owns its storage.
+std::vector<term_t> terms()
+{
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    double cutoff = sieve ? sieve->cutoff() : 0.0;
+    order_.clear();
+    for (size_t index = 0; index < terms_.size(); index++) {
+        if (cutoff > 0.0 && std::abs(terms_[index].second) <= cutoff) continue;
+        order_.push_back(index);
     }
-    for (; indexb < b.variables().size(); indexb++) {
-        variables.push_back(b.variables()[indexb]);
+    if (order_.size() != terms_.size()) sieve->add_npruned(terms_.size() - order_.size());
+    nentry_++;
+    nterm_ += order_.size();
+    max_entry_terms_ = std::max(max_entry_terms_, order_.size());
+    std::sort(order_.begin(), order_.end(), [this](size_t a, size_t b) { return terms_[a].first < terms_[b].first; });
+    std::vector<term_t> terms;
+    terms.reserve(order_.size());
+    for (auto index : order_) {
+        term_t& term = terms_[index];
+        if (term.first.temporary()) {
+            terms.push_back(term_t(TrigMonomial(term.first), term.second));
+        } else {
+            terms.push_back(std::move(term));
+        }
     }
+    clear();
+    return terms;
+}
 
-    return TrigMonomial(variables);
+// Destroys terms in reverse insertion order so arena storage unwinds LIFO
+void clear()
+{
+    for (auto slot : used_) {
+        slots_[slot] = empty;
+    }
+    used_.clear();
+    while (!terms_.empty()) {
+        terms_.pop_back();
+    }
 }
 
+protected:
+
+size_t nproduct_;
+size_t nmultiply_;
+size_t nentry_;
+size_t nterm_;
+size_t max_entry_terms_;
+
 private:
 
-std::vector<std::pair<char, int>> variables_;
+static const size_t empty = ~((size_t) 0);
+
+std::vector<term_t> terms_;
+std::vector<size_t> slots_;
+std::vector<size_t> used_;
+std::vector<size_t> order_;
+
+size_t find(const TrigMonomial& monomial, size_t hash)
+{
+    if (slots_.empty()) rehash(16);
+    size_t mask = slots_.size() - 1;
+    size_t slot = hash & mask;
+    while (slots_[slot] != empty && terms_[slots_[slot]].first != monomial) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void rehash(size_t capacity)
+{
+    slots_.assign(capacity, (size_t) empty);
+    used_.clear();
+    size_t mask = capacity - 1;
+    for (size_t index = 0; index < terms_.size(); index++) {
+        size_t slot = terms_[index].first.hash() & mask;
+        while (slots_[slot] != empty) {
+            slot = (slot + 1) & mask;
+        }
+        slots_[slot] = index;
+        used_.push_back(slot);
+    }
+}
 
 };
 
+typedef BasicTrigAccumulator<std::complex<double>> TrigAccumulator;
+
 class TrigPolynomial {
 
 public:
 
+typedef TrigAccumulator accumulator_t;
+
 TrigPolynomial(
     const std::map<TrigMonomial, std::complex<double>>& polynomial) :
-    polynomial_(polynomial)
+    terms_(polynomial.begin(), polynomial.end())
     {}
 
 TrigPolynomial(){}
 
-const std::map<TrigMonomial, std::complex<double>>& polynomial() const { return polynomial_; }
+// Terms must be sorted by monomial with no repeated monomials
+static
+TrigPolynomial from_terms(std::vector<trig_term_t>&& terms)
+{
+    TrigPolynomial poly;
+    poly.terms_ = std::move(terms);
+    return poly;
+}
+
+const std::vector<trig_term_t>& terms() const { return terms_; }
+
+std::map<TrigMonomial, std::complex<double>> polynomial() const { return std::map<TrigMonomial, std::complex<double>>(terms_.begin(), terms_.end()); }
 
 static 
 TrigPolynomial zero() { return TrigPolynomial(); }
@@ -108,39 +541,27 @@ TrigPolynomial one() { return TrigPolynomial({{ TrigMonomial::one(), 1.0}}); }
 
 TrigPolynomial operator+() const 
 { 
-    std::map<TrigMonomial, std::complex<double>> polynomial;
-    for (auto const& it : polynomial_) {
-        const TrigMonomial& monomial = it.first;
-        const std::complex<double>& coefficient = it.second;
-        polynomial[monomial] = +coefficient;
-    }
-    return TrigPolynomial(polynomial);
+    return *this;
 }
     
 TrigPolynomial operator-() const 
 { 
-    std::map<TrigMonomial, std::complex<double>> polynomial;
-    for (auto const& it : polynomial_) {
-        const TrigMonomial& monomial = it.first;
-        const std::complex<double>& coefficient = it.second;
-        polynomial[monomial] = -coefficient;
+    TrigPolynomial poly = *this;
+    for (auto& term : poly.terms_) {
+        term.second = -term.second;
     }
-    return TrigPolynomial(polynomial);
+    return poly;
 }
 
 TrigPolynomial& operator+=(const TrigPolynomial& other)
 {
-    for (auto const& it : other.polynomial()) {
-        polynomial_[it.first] += it.second;
-    } 
+    merge(other, +1.0);
     return *this;
 }
     
 TrigPolynomial& operator-=(const TrigPolynomial& other)
 {
-    for (auto const& it : other.polynomial()) {
-        polynomial_[it.first] -= it.second;
-    } 
+    merge(other, -1.0);
     return *this;
 }
 
@@ -160,24 +581,20 @@ TrigPolynomial operator-(const TrigPolynomial& other) const
     
 friend TrigPolynomial operator*(const TrigPolynomial& a, const TrigPolynomial& b)
 {
-    std::map<TrigMonomial, std::complex<double>> polynomial;
-    for (auto const& ita : a.polynomial()) {
-        for (auto const& itb : b.polynomial()) {
-            polynomial[ita.first * itb.first] += ita.second * itb.second;
-        }
-    }
-    return TrigPolynomial(polynomial);
+    static thread_local TrigAccumulator accumulator;
+    accumulator.add_product(a.terms(), b.terms());
+    TrigPolynomial product = TrigPolynomial::from_terms(accumulator.terms());
+    accumulator.flush();
+    return product;
 }
 
 TrigPolynomial operator*(const std::complex<double>& scalar) const 
 { 
-    std::map<TrigMonomial, std::complex<double>> polynomial;
-    for (auto const& it : polynomial_) {
-        const TrigMonomial& monomial = it.first;
-        const std::complex<double>& coefficient = it.second;
-        polynomial[monomial] = coefficient * scalar;
+    TrigPolynomial poly = *this;
+    for (auto& term : poly.terms_) {
+        term.second = term.second * scalar;
     }
-    return TrigPolynomial(polynomial);
+    return poly;
 }
 
 friend TrigPolynomial operator*(const std::complex<double>& scalar, const TrigPolynomial& poly)
@@ -187,45 +604,41 @@ friend TrigPolynomial operator*(const std::complex<double>& scalar, const TrigPo
 
 TrigPolynomial operator/(const std::complex<double>& scalar) const 
 { 
-    std::map<TrigMonomial, std::complex<double>> polynomial;
-    for (auto const& it : polynomial_) {
-        const TrigMonomial& monomial = it.first;
-        const std::complex<double>& coefficient = it.second;
-        polynomial[monomial] = coefficient / scalar;
+    TrigPolynomial poly = *this;
+    for (auto& term : poly.terms_) {
+        term.second = term.second / scalar;
     }
-    return TrigPolynomial(polynomial);
+    return poly;
 }
 
 TrigPolynomial operator+=(const std::complex<double>& scalar)
 {
-    std::map<TrigMonomial, std::complex<double>> polynomial = polynomial_;
-    for (auto const& it : polynomial_) {
-        polynomial[it.first] = it.second + scalar;
+    TrigPolynomial poly = *this;
+    for (auto& term : poly.terms_) {
+        term.second = term.second + scalar;
     }
-    return TrigPolynomial(polynomial);
+    return poly;
 }
 
 TrigPolynomial operator+(const std::complex<double>& scalar) const
 {
-    std::map<TrigMonomial, std::complex<double>> polynomial = polynomial_;
-    polynomial[TrigMonomial::one()] += scalar;
-    return TrigPolynomial(polynomial);
+    TrigPolynomial poly = *this;
+    poly += TrigPolynomial::from_terms({trig_term_t(TrigMonomial::one(), scalar)});
+    return poly;
 }
 
 friend TrigPolynomial operator+(const std::complex<double>& scalar, const TrigPolynomial& poly) 
 {
-    std::map<TrigMonomial, std::complex<double>> polynomial = poly.polynomial();
-    polynomial[TrigMonomial::one()] += scalar;
-    return TrigPolynomial(polynomial);
+    return poly + scalar;
 }
 
 TrigPolynomial operator-=(const std::complex<double>& scalar)
 {
-    std::map<TrigMonomial, std::complex<double>> polynomial = polynomial_;
-    for (auto const& it : polynomial_) {
-        polynomial[it.first] = it.second - scalar;
+    TrigPolynomial poly = *this;
+    for (auto& term : poly.terms_) {
+        term.second = term.second - scalar;
     }
-    return TrigPolynomial(polynomial);
+    return poly;
 }
 
 friend TrigPolynomial operator-(const TrigPolynomial& poly, const std::complex<double>& scalar) 
@@ -240,32 +653,30 @@ friend TrigPolynomial operator-(const std::complex<double>& scalar, const TrigPo
 
 TrigPolynomial conj() const
 {
-    std::map<TrigMonomial, std::complex<double>> polynomial;
-    for (auto it : polynomial_) {
-        polynomial[it.first] = std::conj(it.second);
+    TrigPolynomial poly = *this;
+    for (auto& term : poly.terms_) {
+        term.second = std::conj(term.second);
     }
-    return TrigPolynomial(polynomial);
+    return poly;
 }
     
 TrigPolynomial sieved(double cutoff=1.0E-12) const
 {
-    std::map<TrigMonomial, std::complex<double>> polynomial;
-    for (auto it : polynomial_) {
-        if (std::abs(it.second) > cutoff) {
-            polynomial[it.first] = it.second;
+    TrigPolynomial poly;
+    for (auto const& term : terms_) {
+        if (std::abs(term.second) > cutoff) {
+            poly.terms_.push_back(term);
         }
     }
-    return TrigPolynomial(polynomial);
+    return poly;
 }
     
 static
 bool equivalent_keys(const TrigPolynomial& a, const TrigPolynomial& b)
 {
-    if (a.polynomial().size() != b.polynomial().size()) return false; 
+    if (a.terms().size() != b.terms().size()) return false; 
 
-    std::map<TrigMonomial, std::complex<double>> triga = a.polynomial();
-    std::map<TrigMonomial, std::complex<double>> trigb = b.polynomial();
-    for (auto itera = triga.begin(), iterb = trigb.begin(); itera != triga.end(); ++itera, ++iterb) {
+    for (auto itera = a.terms().begin(), iterb = b.terms().begin(); itera != a.terms().end(); ++itera, ++iterb) {
         if (itera->first != iterb->first) return false;
     }
     return true;
@@ -276,9 +687,7 @@ bool equivalent_values(const TrigPolynomial& a, const TrigPolynomial& b, double
 {
     if (!equivalent_keys(a, b)) throw std::runtime_error("Keys must be equivalent");
 
-    std::map<TrigMonomial, std::complex<double>> triga = a.polynomial();
-    std::map<TrigMonomial, std::complex<double>> trigb = b.polynomial();
-    for (auto itera = triga.begin(), iterb = trigb.begin(); itera != triga.end(); ++itera, ++iterb) {
+    for (auto itera = a.terms().begin(), iterb = b.terms().begin(); itera != a.terms().end(); ++itera, ++iterb) {
         if (std::abs(itera->second - iterb->second) > cutoff) return false;
     }
     return true;
@@ -291,8 +700,20 @@ bool equivalent(const TrigPolynomial& a, const TrigPolynomial& b, double cutoff=
     return equivalent_values(a, b);
 }
 
+// d/dsymbol: each term exp(1j*k*symbol) picks up a factor of 1j*k
+TrigPolynomial derivative(const TrigSymbol& symbol) const
+{
+    TrigPolynomial poly;
+    for (auto const& term : terms_) {
+        int order = term.first.order_of(symbol);
+        if (order == 0) continue;
+        poly.terms_.push_back(trig_term_t(term.first, term.second * std::complex<double>(0.0, order)));
+    }
+    return poly;
+}
+
 static
-TrigPolynomial cos(char symbol, int order=1)
+TrigPolynomial cos(const TrigSymbol& symbol, int order=1)
 {
     return TrigPolynomial({
         {TrigMonomial({{symbol, +order}}), +0.5},
@@ -301,7 +722,7 @@ TrigPolynomial cos(char symbol, int order=1)
 }
 
 static
-TrigPolynomial sin(char symbol, int order=1)
+TrigPolynomial sin(const TrigSymbol& symbol, int order=1)
 {
     std::complex<double> I(0.0, 1.0);
     return TrigPolynomial({
@@ -312,8 +733,46 @@ TrigPolynomial sin(char symbol, int order=1)
 
 private:
 
-std::map<TrigMonomial, std::complex<double>> polynomial_;
+std::vector<trig_term_t> terms_;
+
+// Merges the sorted terms of other, scaled by sign, into terms_
+void merge(const TrigPolynomial& other, double sign)
+{
+    if (other.terms_.empty()) return;
+    std::vector<trig_term_t> terms;
+    terms.reserve(terms_.size() + other.terms_.size());
+    auto itera = terms_.begin();
+    auto iterb = other.terms_.begin();
+    while (itera != terms_.end() && iterb != other.terms_.end()) {
+        if (itera->first < iterb->first) {
+            terms.push_back(std::move(*itera++));
+        } else if (iterb->first < itera->first) {
+            terms.push_back(trig_term_t(iterb->first, sign * iterb->second));
+            ++iterb;
+        } else {
+            terms.push_back(trig_term_t(std::move(itera->first), itera->second + sign * iterb->second));
+            ++itera;
+            ++iterb;
+        }
+    }
+    for (; itera != terms_.end(); ++itera) {
+        terms.push_back(std::move(*itera));
+    }
+    for (; iterb != other.terms_.end(); ++iterb) {
+        terms.push_back(trig_term_t(iterb->first, sign * iterb->second));
+    }
+    terms_ = std::move(terms);
+}
 
 };
 
 } // namespace autogate
+
+namespace std {
+
+template <>
+struct hash<autogate::TrigMonomial> {
+    size_t operator()(const autogate::TrigMonomial& monomial) const { return monomial.hash(); }
+};
+
+} // namespace std
@@ -1,3 +1,8 @@
+from .autogate_plugin import TrigArena
+from .autogate_plugin import TrigSymbol
+from .autogate_plugin import TrigSymbolTable
+from .autogate_plugin import TrigSieve
+from .autogate_plugin import TrigCounters
 from .autogate_plugin import TrigMonomial
 
 def _trig_monomial_str(self):
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+namespace autogate {
+
+// Per-thread bump allocator for the variables of temporary product monomials
+// (TrigMonomial::multiply_temporary) that spill past
+// TrigMonomial::inline_capacity. Term vectors, inline monomials and monomials
+// built by the public operators do not use it, so peak_size() stays 0 unless
+// accumulated products exceed inline_capacity variables. The arena is only
+// handed out while a TrigArena::Scope is open on the calling thread, and all
+// of its blocks are released in bulk when the outermost Scope closes. The most
+// recent allocation can be returned early with deallocate, so temporaries
+// destroyed in LIFO order do not grow the arena.
+class TrigArena {
+
+public:
+
+class Scope {
+public:
+Scope() { local().depth_++; }
+~Scope() { TrigArena& arena = local(); if (--arena.depth_ == 0) arena.release(); }
+Scope(const Scope&) = delete;
+Scope& operator=(const Scope&) = delete;
+};
+
+static const size_t block_size = 1ULL<<18;
+
+// The calling thread's arena if a Scope is open, else nullptr
+static TrigArena* current() { TrigArena& arena = local(); return arena.depth_ ? &arena : nullptr; }
+
+void* allocate(size_t bytes)
+{
+    bytes = align(bytes);
+    while (current_ < blocks_.size() && blocks_[current_].used + bytes > blocks_[current_].size) {
+        current_++;
+    }
+    if (current_ == blocks_.size()) {
+        Block block;
+        block.size = std::max(bytes, (size_t) block_size);
+        block.used = 0;
+        block.data.reset(new char[block.size]);
+        size_ += block.size;
+        size_t total = total_size_counter().fetch_add(block.size, std::memory_order_relaxed) + block.size;
+        blocks_.push_back(std::move(block));
+        size_t peak = peak_size_counter().load(std::memory_order_relaxed);
+        while (total > peak && !peak_size_counter().compare_exchange_weak(peak, total, std::memory_order_relaxed)) {}
+    }
+    Block& block = blocks_[current_];
+    void* pointer = block.data.get() + block.used;
+    block.used += bytes;
+    return pointer;
+}
+
+// Reclaims pointer only if it is the most recent live allocation
+void deallocate(void* pointer, size_t bytes)
+{
+    if (current_ == blocks_.size()) return;
+    bytes = align(bytes);
+    Block& block = blocks_[current_];
+    if (block.used < bytes || block.data.get() + block.used - bytes != pointer) return;
+    block.used -= bytes;
+    while (current_ > 0 && blocks_[current_].used == 0) {
+        current_--;
+    }
+}
+
+// Bytes currently reserved by this arena
+size_t size() const { return size_; }
+
+// Bytes currently reserved by the arenas of all threads together
+static size_t total_size() { return total_size_counter().load(); }
+
+// Largest total_size() reached since the last reset_peak_size, i.e. the most
+// arena memory that all threads held at once
+static size_t peak_size() { return peak_size_counter().load(); }
+static void reset_peak_size() { peak_size_counter().store(total_size()); }
+
+private:
+
+struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+    size_t used;
+};
+
+std::vector<Block> blocks_;
+size_t current_ = 0;
+size_t size_ = 0;
+size_t depth_ = 0;
+
+TrigArena() {}
+
+static TrigArena& local() { static thread_local TrigArena arena; return arena; }
+
+static std::atomic<size_t>& total_size_counter() { static std::atomic<size_t> total_size(0); return total_size; }
+static std::atomic<size_t>& peak_size_counter() { static std::atomic<size_t> peak_size(0); return peak_size; }
+
+static size_t align(size_t bytes) { return (bytes + 7) & ~((size_t) 7); }
+
+void release()
+{
+    total_size_counter().fetch_sub(size_, std::memory_order_relaxed);
+    blocks_.clear();
+    current_ = 0;
+    size_ = 0;
+}
+
+};
+
+} // namespace autogate
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "trig_tensor.hpp"
+#include <unordered_map>
+#include <set>
+
+namespace autogate {
+
+// Numeric evaluator for a TrigTensor at bound parameter values. All terms of
+// the tensor are flattened once into contiguous arrays: per-entry term ranges,
+// term coefficients, and for each term the index of its monomial in a table of
+// unique monomials. The monomials form a CSR exponent matrix (per-monomial
+// variable ranges, symbol indices, and orders). Evaluation at an angle vector
+// tabulates exp(1j*k*theta) for every symbol and order present, evaluates each
+// unique monomial once as a product of table lookups, and then sums
+// coefficient * monomial over the terms of each entry.
+class TrigEvaluator {
+
+public:
+
+TrigEvaluator() {}
+
+TrigEvaluator(
+    const TrigTensor& tensor,
+    const std::vector<TrigSymbol>& symbols) :
+    shape_(tensor.shape()),
+    symbols_(symbols)
+{
+    // Position of each symbol in symbols, indexed by TrigSymbol id
+    std::vector<uint32_t> symbol_indices;
+    for (size_t index = 0; index < symbols_.size(); index++) {
+        uint32_t id = symbols_[index].id();
+        if (id >= symbol_indices.size()) symbol_indices.resize(id + 1, (uint32_t) unbound);
+        if (symbol_indices[id] != unbound) throw std::runtime_error("Repeated symbols");
+        symbol_indices[id] = index;
+    }
+
+    std::unordered_map<TrigMonomial, uint64_t> monomial_indices;
+    entry_offsets_.push_back(0);
+    monomial_offsets_.push_back(0);
+    for (auto const& poly : tensor.data()) {
+        for (auto const& term : poly.terms()) {
+            auto inserted = monomial_indices.insert(std::make_pair(term.first, (uint64_t) monomial_indices.size()));
+            if (inserted.second) {
+                for (const TrigMonomial::word_t* word = term.first.begin(); word != term.first.end(); ++word) {
+                    uint32_t id = TrigMonomial::symbol(*word);
+                    if (id >= symbol_indices.size() || symbol_indices[id] == unbound) throw std::runtime_error("Tensor contains a symbol not in symbols");
+                    uint32_t index = symbol_indices[id];
+                    int order = TrigMonomial::order(*word);
+                    variable_symbols_.push_back(index);
+                    variable_orders_.push_back(order);
+                }
+                monomial_offsets_.push_back(variable_symbols_.size());
+            }
+            coefficients_.push_back(term.second);
+            term_monomials_.push_back(inserted.first->second);
+        }
+        entry_offsets_.push_back(coefficients_.size());
+    }
+    build_table();
+}
+
+// Evaluator over already-flattened arrays (as exposed by the accessors below),
+// e.g. as read back by BinaryIO. The arrays are validated but not re-sorted.
+TrigEvaluator(
+    const std::vector<size_t>& shape,
+    const std::vector<TrigSymbol>& symbols,
+    std::vector<uint64_t> entry_offsets,
+    std::vector<std::complex<double>> coefficients,
+    std::vector<uint64_t> term_monomials,
+    std::vector<uint64_t> monomial_offsets,
+    std::vector<uint32_t> variable_symbols,
+    std::vector<int32_t> variable_orders) :
+    shape_(shape),
+    symbols_(symbols),
+    entry_offsets_(std::move(entry_offsets)),
+    coefficients_(std::move(coefficients)),
+    term_monomials_(std::move(term_monomials)),
+    monomial_offsets_(std::move(monomial_offsets)),
+    variable_symbols_(std::move(variable_symbols)),
+    variable_orders_(std::move(variable_orders))
+{
+    size_t nentry = 1;
+    for (auto dim : shape_) {
+        nentry *= dim;
+    }
+    if (entry_offsets_.size() != nentry + 1 || entry_offsets_.front() != 0 || entry_offsets_.back() != coefficients_.size()) throw std::runtime_error("entry_offsets do not match shape and coefficients");
+    if (!std::is_sorted(entry_offsets_.begin(), entry_offsets_.end())) throw std::runtime_error("entry_offsets must be sorted");
+    if (term_monomials_.size() != coefficients_.size()) throw std::runtime_error("term_monomials.size() != coefficients.size()");
+    if (monomial_offsets_.empty() || monomial_offsets_.front() != 0 || monomial_offsets_.back() != variable_symbols_.size()) throw std::runtime_error("monomial_offsets do not match variable_symbols");
+    if (!std::is_sorted(monomial_offsets_.begin(), monomial_offsets_.end())) throw std::runtime_error("monomial_offsets must be sorted");
+    if (variable_orders_.size() != variable_symbols_.size()) throw std::runtime_error("variable_orders.size() != variable_symbols.size()");
+    for (auto monomial : term_monomials_) {
+        if (monomial >= nmonomial()) throw std::runtime_error("term_monomials out of range");
+    }
+    for (auto symbol : variable_symbols_) {
+        if (symbol >= symbols_.size()) throw std::runtime_error("variable_symbols out of range");
+    }
+    build_table();
+}
+
+// The distinct symbols of tensor, ordered by TrigSymbol id
+static std::vector<TrigSymbol> symbols_of(const TrigTensor& tensor)
+{
+    std::set<uint32_t> ids;
+    for (auto const& poly : tensor.data()) {
+        for (auto const& term : poly.terms()) {
+            for (const TrigMonomial::word_t* word = term.first.begin(); word != term.first.end(); ++word) {
+                ids.insert(TrigMonomial::symbol(*word));
+            }
+        }
+    }
+    std::vector<TrigSymbol> symbols;
+    for (auto id : ids) {
+        symbols.push_back(TrigSymbol::from_id(id));
+    }
+    return symbols;
+}
+
+// The symbolic tensor these arrays encode
+TrigTensor tensor() const
+{
+    TrigTensor tensor(shape_);
+    std::vector<TrigMonomial::word_t> words;
+    for (size_t entry = 0; entry < size(); entry++) {
+        std::vector<trig_term_t> terms;
+        for (uint64_t term = entry_offsets_[entry]; term < entry_offsets_[entry+1]; term++) {
+            uint64_t monomial = term_monomials_[term];
+            words.clear();
+            for (uint64_t variable = monomial_offsets_[monomial]; variable < monomial_offsets_[monomial+1]; variable++) {
+                words.push_back(TrigMonomial::pack(symbols_[variable_symbols_[variable]].id(), variable_orders_[variable]));
+            }
+            std::sort(words.begin(), words.end());
+            terms.push_back(trig_term_t(TrigMonomial::from_words(words.data(), words.data() + words.size()), coefficients_[term]));
+        }
+        std::sort(terms.begin(), terms.end(), [](const trig_term_t& a, const trig_term_t& b) { return a.first < b.first; });
+        tensor.data()[entry] = TrigPolynomial::from_terms(std::move(terms));
+    }
+    return tensor;
+}
+
+const std::vector<size_t>& shape() const { return shape_; }
+const std::vector<TrigSymbol>& symbols() const { return symbols_; }
+size_t size() const { return entry_offsets_.size() - 1; }
+size_t nterm() const { return coefficients_.size(); }
+size_t nmonomial() const { return monomial_offsets_.size() - 1; }
+
+const std::vector<uint64_t>& entry_offsets() const { return entry_offsets_; }
+const std::vector<std::complex<double>>& coefficients() const { return coefficients_; }
+const std::vector<uint64_t>& term_monomials() const { return term_monomials_; }
+const std::vector<uint64_t>& monomial_offsets() const { return monomial_offsets_; }
+const std::vector<uint32_t>& variable_symbols() const { return variable_symbols_; }
+const std::vector<int32_t>& variable_orders() const { return variable_orders_; }
+
+// Dense nmonomial() x symbols().size() exponent matrix (row-major): the order of
+// each symbol in each unique monomial
+std::vector<int32_t> exponents() const
+{
+    std::vector<int32_t> exponents(nmonomial() * symbols_.size(), 0);
+    for (size_t monomial = 0; monomial < nmonomial(); monomial++) {
+        for (uint64_t variable = monomial_offsets_[monomial]; variable < monomial_offsets_[monomial+1]; variable++) {
+            exponents[monomial * symbols_.size() + variable_symbols_[variable]] = variable_orders_[variable];
+        }
+    }
+    return exponents;
+}
+
+// Number of complex scratch elements needed by evaluate
+size_t scratch_size() const { return table_size_ + nmonomial(); }
+
+std::vector<std::complex<double>> evaluate(const std::vector<double>& angles) const
+{
+    if (angles.size() != symbols_.size()) throw std::runtime_error("angles.size() != symbols.size()");
+    std::vector<std::complex<double>> values(size());
+    std::vector<std::complex<double>> scratch(scratch_size());
+    evaluate(angles.data(), values.data(), scratch.data());
+    return values;
+}
+
+// Evaluates at angles (one per symbol) into values (one per tensor entry),
+// using scratch (scratch_size() elements) for the order table and monomials
+void evaluate(
+    const double* angles,
+    std::complex<double>* values,
+    std::complex<double>* scratch) const
+{
+    std::complex<double>* table = scratch;
+    std::complex<double>* monomials = scratch + table_size_;
+    fill_table(angles, table);
+    fill_monomials(table, monomials);
+
+    const size_t nentry = size();
+    for (size_t entry = 0; entry < nentry; entry++) {
+        double real = 0.0;
+        double imag = 0.0;
+        for (uint64_t term = entry_offsets_[entry]; term < entry_offsets_[entry+1]; term++) {
+            const std::complex<double>& coefficient = coefficients_[term];
+            const std::complex<double>& monomial = monomials[term_monomials_[term]];
+            real += coefficient.real() * monomial.real() - coefficient.imag() * monomial.imag();
+            imag += coefficient.real() * monomial.imag() + coefficient.imag() * monomial.real();
+        }
+        values[entry] = std::complex<double>(real, imag);
+    }
+}
+
+// Evaluates values as in evaluate together with gradients (symbols().size() x
+// size(), row-major) holding d/dtheta_s of every entry, in one pass over the
+// shared monomials: d/dtheta_s of exp(1j*k.theta) is 1j*k_s*exp(1j*k.theta)
+void evaluate_gradient(
+    const double* angles,
+    std::complex<double>* values,
+    std::complex<double>* gradients,
+    std::complex<double>* scratch) const
+{
+    std::complex<double>* table = scratch;
+    std::complex<double>* monomials = scratch + table_size_;
+    fill_table(angles, table);
+    fill_monomials(table, monomials);
+
+    const size_t nentry = size();
+    std::fill(gradients, gradients + symbols_.size() * nentry, std::complex<double>(0.0, 0.0));
+    for (size_t entry = 0; entry < nentry; entry++) {
+        double real = 0.0;
+        double imag = 0.0;
+        for (uint64_t term = entry_offsets_[entry]; term < entry_offsets_[entry+1]; term++) {
+            const std::complex<double>& coefficient = coefficients_[term];
+            uint64_t monomial_index = term_monomials_[term];
+            const std::complex<double>& monomial = monomials[monomial_index];
+            double term_real = coefficient.real() * monomial.real() - coefficient.imag() * monomial.imag();
+            double term_imag = coefficient.real() * monomial.imag() + coefficient.imag() * monomial.real();
+            real += term_real;
+            imag += term_imag;
+            for (uint64_t variable = monomial_offsets_[monomial_index]; variable < monomial_offsets_[monomial_index+1]; variable++) {
+                double order = variable_orders_[variable];
+                gradients[variable_symbols_[variable] * nentry + entry] += std::complex<double>(-order * term_imag, order * term_real);
+            }
+        }
+        values[entry] = std::complex<double>(real, imag);
+    }
+}
+
+// Evaluates nbatch angle vectors (nbatch x symbols().size(), row-major) into
+// values (nbatch x size(), row-major), spreading the batch over Parallel::num_threads()
+void evaluate_batch(
+    const double* angles,
+    size_t nbatch,
+    std::complex<double>* values) const
+{
+    const size_t nsymbol = symbols_.size();
+    const size_t nentry = size();
+    #pragma omp parallel num_threads(Parallel::num_threads())
+    {
+        std::vector<std::complex<double>> scratch(scratch_size());
+        #pragma omp for schedule(static)
+        for (ssize_t batch = 0; batch < (ssize_t) nbatch; batch++) {
+            evaluate(angles + batch * nsymbol, values + batch * nentry, scratch.data());
+        }
+    }
+}
+
+private:
+
+static const uint32_t unbound = ~((uint32_t) 0);
+
+std::vector<size_t> shape_;
+std::vector<TrigSymbol> symbols_;
+
+std::vector<uint64_t> entry_offsets_;
+std::vector<std::complex<double>> coefficients_;
+std::vector<uint64_t> term_monomials_;
+std::vector<uint64_t> monomial_offsets_;
+std::vector<uint32_t> variable_symbols_;
+std::vector<int32_t> variable_orders_;
+
+std::vector<int> max_orders_;
+std::vector<size_t> table_offsets_;
+size_t table_size_ = 0;
+
+// Table of exp(1j*k*theta_s) for k in [-max_order_s, +max_order_s], with
+// table_offsets_[s] pointing at k = 0
+void build_table()
+{
+    max_orders_.assign(symbols_.size(), 0);
+    for (size_t variable = 0; variable < variable_symbols_.size(); variable++) {
+        int& max_order = max_orders_[variable_symbols_[variable]];
+        max_order = std::max(max_order, std::abs((int) variable_orders_[variable]));
+    }
+    table_offsets_.clear();
+    table_size_ = 0;
+    for (size_t index = 0; index < symbols_.size(); index++) {
+        table_offsets_.push_back(table_size_ + max_orders_[index]);
+        table_size_ += 2 * max_orders_[index] + 1;
+    }
+}
+
+void fill_table(const double* angles, std::complex<double>* table) const
+{
+    for (size_t index = 0; index < symbols_.size(); index++) {
+        std::complex<double>* row = table + table_offsets_[index];
+        int max_order = max_orders_[index];
+        row[0] = 1.0;
+        for (int order = 1; order <= max_order; order++) {
+            row[+order] = std::polar(1.0, order * angles[index]);
+            row[-order] = std::conj(row[+order]);
+        }
+    }
+}
+
+void fill_monomials(const std::complex<double>* table, std::complex<double>* monomials) const
+{
+    const size_t nmonomial2 = nmonomial();
+    for (size_t monomial = 0; monomial < nmonomial2; monomial++) {
+        double real = 1.0;
+        double imag = 0.0;
+        for (uint64_t variable = monomial_offsets_[monomial]; variable < monomial_offsets_[monomial+1]; variable++) {
+            const std::complex<double>& factor = table[table_offsets_[variable_symbols_[variable]] + variable_orders_[variable]];
+            double real2 = real * factor.real() - imag * factor.imag();
+            imag = real * factor.imag() + imag * factor.real();
+            real = real2;
+        }
+        monomials[monomial] = std::complex<double>(real, imag);
+    }
+}
+
+};
+
+} // namespace autogate
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "trig_tensor.hpp"
+#include <memory>
+#include <unordered_map>
+
+namespace autogate {
+
+// Table of unique polynomials. Polynomials with the same monomials and
+// coefficients equal to within cutoff share one stored instance, and a
+// polynomial and its negation share it too. A handle is 2*id + negated, and
+// handle 0 is always the zero polynomial.
+class TrigInternTable {
+
+public:
+
+typedef size_t handle_t;
+
+TrigInternTable(double cutoff=1.0E-12) :
+    cutoff_(cutoff),
+    values_(1)
+{
+    if (cutoff_ < 0.0) throw std::runtime_error("cutoff must be >= 0");
+}
+
+double cutoff() const { return cutoff_; }
+// Number of unique stored polynomials, including zero
+size_t size() const { return values_.size(); }
+
+static size_t id(handle_t handle) { return handle >> 1; }
+static bool negated(handle_t handle) { return handle & 1; }
+
+// The stored polynomial of handle's id, which is handle's value up to sign
+const TrigPolynomial& value(handle_t handle) const { return values_[id(handle)]; }
+
+TrigPolynomial polynomial(handle_t handle) const { return negated(handle) ? -value(handle) : value(handle); }
+
+handle_t intern(const TrigPolynomial& poly)
+{
+    if (poly.terms().empty()) return 0;
+
+    // Stored values are scaled so that their leading coefficient points into
+    // the right half plane (or the upper half of the imaginary axis)
+    std::complex<double> lead = poly.terms()[0].second;
+    bool negate = std::abs(lead.real()) > cutoff_ ? lead.real() < 0.0 : lead.imag() < 0.0;
+
+    size_t key = hash_keys(poly);
+    auto range = index_.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        const TrigPolynomial& stored = values_[it->second];
+        if (!TrigPolynomial::equivalent_keys(stored, poly)) continue;
+        if (equivalent_values(stored, poly, negate)) return 2 * it->second + negate;
+    }
+
+    size_t id = values_.size();
+    values_.push_back(negate ? -poly : poly);
+    index_.insert(std::make_pair(key, id));
+    return 2 * id + negate;
+}
+
+private:
+
+double cutoff_;
+std::vector<TrigPolynomial> values_;
+std::unordered_multimap<size_t, size_t> index_;
+
+static size_t hash_keys(const TrigPolynomial& poly)
+{
+    size_t hash = poly.terms().size();
+    for (auto const& term : poly.terms()) {
+        hash ^= term.first.hash() + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+bool equivalent_values(const TrigPolynomial& stored, const TrigPolynomial& poly, bool negate) const
+{
+    double sign = negate ? -1.0 : 1.0;
+    for (auto iters = stored.terms().begin(), iterp = poly.terms().begin(); iters != stored.terms().end(); ++iters, ++iterp) {
+        if (std::abs(iters->second - sign * iterp->second) > cutoff_) return false;
+    }
+    return true;
+}
+
+};
+
+// A 2-index tensor whose entries are handles into a shared TrigInternTable, so
+// that repeated polynomials (cos(a), one(), sign-flipped copies) are stored once.
+// gemm memoises the product of each (a, b) id pair, so a pair that recurs across
+// many output entries is only multiplied once per thread.
+class TrigInternedTensor {
+
+public:
+
+typedef TrigInternTable::handle_t handle_t;
+
+// Default bound on the terms each thread memoises during one gemm (roughly
+// 80 bytes per term). Once it is reached, pairs not yet memoised are
+// multiplied every time they occur.
+static const size_t default_max_memo_terms = 1ULL<<18;
+
+TrigInternedTensor() {}
+
+TrigInternedTensor(
+    const std::vector<size_t>& shape,
+    const std::shared_ptr<TrigInternTable>& table) :
+    shape_(shape),
+    table_(table)
+{
+    if (shape_.size() != 2) throw std::runtime_error("TrigInternedTensor must have 2 indices");
+    handles_.resize(shape_[0] * shape_[1]);
+}
+
+const std::vector<size_t>& shape() const { return shape_; }
+const std::vector<handle_t>& handles() const { return handles_; }
+const std::shared_ptr<TrigInternTable>& table() const { return table_; }
+// Number of unique polynomials (up to sign) in the table, including zero
+size_t nunique() const { return table_->size(); }
+
+static TrigInternedTensor from_dense(const TrigTensor& dense, double cutoff=1.0E-12)
+{
+    return from_dense(dense, std::make_shared<TrigInternTable>(cutoff));
+}
+
+static TrigInternedTensor from_dense(const TrigTensor& dense, const std::shared_ptr<TrigInternTable>& table)
+{
+    TrigInternedTensor tensor(dense.shape(), table);
+    const std::vector<TrigPolynomial>& data = dense.data();
+    for (size_t index = 0; index < data.size(); index++) {
+        tensor.handles_[index] = table->intern(data[index]);
+    }
+    return tensor;
+}
+
+TrigTensor dense() const
+{
+    TrigTensor tensor(shape_);
+    std::vector<TrigPolynomial>& data = tensor.data();
+    for (size_t index = 0; index < handles_.size(); index++) {
+        data[index] = table_->polynomial(handles_[index]);
+    }
+    return tensor;
+}
+
+// The result is interned into a's table. If b uses a different table its
+// entries are interned into a's table first. Each thread memoises at most
+// max_memo_terms product terms; the memo is dropped when gemm returns.
+static TrigInternedTensor gemm(
+    const TrigInternedTensor& a,
+    const TrigInternedTensor& b,
+    size_t max_memo_terms=default_max_memo_terms)
+{
+    if (a.shape()[1] != b.shape()[0]) throw std::runtime_error("Tensors are not conformal");
+
+    const std::shared_ptr<TrigInternTable>& table = a.table_;
+    const TrigInternedTensor b2 = b.table_ == table ? b : from_dense(b.dense(), table);
+    const std::vector<handle_t>& ahandles = a.handles_;
+    const std::vector<handle_t>& bhandles = b2.handles_;
+    const size_t nrow = a.shape()[0];
+    const size_t nk = a.shape()[1];
+    const size_t ncol = b.shape()[1];
+    const size_t nunique = table->size();
+
+    std::vector<std::vector<size_t>> arows(nrow);
+    std::vector<std::vector<size_t>> bcols(ncol);
+    for (size_t k = 0; k < nk; k++) {
+        for (size_t i = 0; i < nrow; i++) {
+            if (ahandles[i*nk + k]) arows[i].push_back(k);
+        }
+        for (size_t j = 0; j < ncol; j++) {
+            if (bhandles[k*ncol + j]) bcols[j].push_back(k);
+        }
+    }
+
+    std::vector<TrigPolynomial> data(nrow * ncol);
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel num_threads(Parallel::num_threads())
+    {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        TrigAccumulator accumulator;
+        std::unordered_map<size_t, TrigPolynomial> products;
+        size_t nmemo_terms = 0;
+        TrigPolynomial unmemoised;
+        #pragma omp for schedule(dynamic)
+        for (ssize_t i = 0; i < (ssize_t) nrow; i++) {
+            for (size_t j = 0; j < ncol; j++) {
+                auto itera = arows[i].begin();
+                auto iterb = bcols[j].begin();
+                while (itera != arows[i].end() && iterb != bcols[j].end()) {
+                    if (*itera < *iterb) {
+                        ++itera;
+                    } else if (*iterb < *itera) {
+                        ++iterb;
+                    } else {
+                        handle_t ha = ahandles[i*nk + *itera];
+                        handle_t hb = bhandles[*iterb*ncol + j];
+                        size_t key = TrigInternTable::id(ha) * nunique + TrigInternTable::id(hb);
+                        const TrigPolynomial* product;
+                        auto memo = products.find(key);
+                        if (memo != products.end()) {
+                            product = &memo->second;
+                        } else {
+                            unmemoised = table->value(ha) * table->value(hb);
+                            product = &unmemoised;
+                            if (nmemo_terms + unmemoised.terms().size() <= max_memo_terms) {
+                                nmemo_terms += unmemoised.terms().size();
+                                product = &products.insert(std::make_pair(key, std::move(unmemoised))).first->second;
+                            }
+                        }
+                        double sign = (TrigInternTable::negated(ha) != TrigInternTable::negated(hb)) ? -1.0 : 1.0;
+                        for (auto const& term : product->terms()) {
+                            accumulator.add(term.first, sign * term.second);
+                        }
+                        ++itera;
+                        ++iterb;
+                    }
+                }
+                data[i*ncol + j] = TrigPolynomial::from_terms(accumulator.terms());
+            }
+        }
+    }
+
+    TrigInternedTensor tensor(std::vector<size_t>{nrow, ncol}, table);
+    for (size_t index = 0; index < data.size(); index++) {
+        tensor.handles_[index] = table->intern(data[index]);
+    }
+    return tensor;
+}
+
+private:
+
+std::vector<size_t> shape_;
+std::vector<handle_t> handles_;
+std::shared_ptr<TrigInternTable> table_;
+
+};
+
+} // namespace autogate
@@ -0,0 +1,348 @@
+#pragma once
+
+#include "trig_tensor.hpp"
+#include <tuple>
+
+namespace autogate {
+
+// Real trigonometric basis: a monomial is a product over symbols of
+// cos(symbol)^p * sin(symbol)^q with q in {0, 1} (sin^2 is always reduced to
+// 1 - cos^2, so the basis is linearly independent). cos and sin are exactly
+// TrigPolynomial::cos and TrigPolynomial::sin, sign convention included.
+// Monomials reuse the packed TrigMonomial storage with the order field holding
+// 2*p + q.
+typedef std::pair<TrigMonomial, double> real_trig_term_t;
+
+class RealTrigAccumulator : public BasicTrigAccumulator<double> {
+
+public:
+
+static TrigMonomial::word_t pack(uint32_t symbol, int cos_power, int sin_power) { return TrigMonomial::pack(symbol, 2 * cos_power + sin_power); }
+static int cos_power(TrigMonomial::word_t word) { return TrigMonomial::order(word) / 2; }
+static int sin_power(TrigMonomial::word_t word) { return TrigMonomial::order(word) % 2; }
+
+// Products of monomials sharing a sin factor expand sin^2 = 1 - cos^2, so each
+// pair contributes 2^m terms for m shared sin factors
+void add_product(const std::vector<real_trig_term_t>& a, const std::vector<real_trig_term_t>& b)
+{
+    nproduct_++;
+    nmultiply_ += a.size() * b.size();
+    for (auto const& terma : a) {
+        for (auto const& termb : b) {
+            add_product(terma.first, termb.first, terma.second * termb.second);
+        }
+    }
+}
+
+private:
+
+// Merged (symbol, cos power, sin power) of the product, and the positions in it
+// of sin^2 factors still to be reduced
+std::vector<std::pair<uint32_t, std::pair<int, int>>> factors_;
+std::vector<size_t> squares_;
+std::vector<TrigMonomial::word_t> words_;
+
+void add_product(const TrigMonomial& a, const TrigMonomial& b, double coefficient)
+{
+    factors_.clear();
+    squares_.clear();
+    const TrigMonomial::word_t* itera = a.begin();
+    const TrigMonomial::word_t* iterb = b.begin();
+    while (itera != a.end() || iterb != b.end()) {
+        uint32_t symbola = itera != a.end() ? TrigMonomial::symbol(*itera) : std::numeric_limits<uint32_t>::max();
+        uint32_t symbolb = iterb != b.end() ? TrigMonomial::symbol(*iterb) : std::numeric_limits<uint32_t>::max();
+        if (itera != a.end() && (iterb == b.end() || symbola < symbolb)) {
+            factors_.push_back(std::make_pair(symbola, std::make_pair(cos_power(*itera), sin_power(*itera))));
+            ++itera;
+        } else if (itera == a.end() || symbolb < symbola) {
+            factors_.push_back(std::make_pair(symbolb, std::make_pair(cos_power(*iterb), sin_power(*iterb))));
+            ++iterb;
+        } else {
+            int sin2 = sin_power(*itera) + sin_power(*iterb);
+            if (sin2 == 2) squares_.push_back(factors_.size());
+            factors_.push_back(std::make_pair(symbola, std::make_pair(cos_power(*itera) + cos_power(*iterb), sin2 % 2)));
+            ++itera;
+            ++iterb;
+        }
+    }
+
+    for (size_t mask = 0; mask < (1ULL<<squares_.size()); mask++) {
+        words_.clear();
+        size_t square = 0;
+        for (size_t index = 0; index < factors_.size(); index++) {
+            int cos2 = factors_[index].second.first;
+            if (square < squares_.size() && squares_[square] == index) {
+                if ((mask >> square) & 1ULL) cos2 += 2;
+                square++;
+            }
+            if (cos2 == 0 && factors_[index].second.second == 0) continue;
+            words_.push_back(pack(factors_[index].first, cos2, factors_[index].second.second));
+        }
+        double sign = (__builtin_popcountll(mask) & 1) ? -1.0 : 1.0;
+        add(TrigMonomial::from_words(words_.data(), words_.data() + words_.size(), true), sign * coefficient);
+    }
+}
+
+};
+
+class RealTrigPolynomial {
+
+public:
+
+typedef RealTrigAccumulator accumulator_t;
+
+RealTrigPolynomial() {}
+
+// Terms must be sorted by monomial with no repeated monomials
+static
+RealTrigPolynomial from_terms(std::vector<real_trig_term_t>&& terms)
+{
+    RealTrigPolynomial poly;
+    poly.terms_ = std::move(terms);
+    return poly;
+}
+
+const std::vector<real_trig_term_t>& terms() const { return terms_; }
+
+// [([(symbol, cos power, sin power)], coefficient)] for each term
+std::vector<std::pair<std::vector<std::tuple<TrigSymbol, int, int>>, double>> factors() const
+{
+    std::vector<std::pair<std::vector<std::tuple<TrigSymbol, int, int>>, double>> factors;
+    for (auto const& term : terms_) {
+        std::vector<std::tuple<TrigSymbol, int, int>> factors2;
+        for (const TrigMonomial::word_t* word = term.first.begin(); word != term.first.end(); ++word) {
+            factors2.push_back(std::make_tuple(TrigSymbol::from_id(TrigMonomial::symbol(*word)), RealTrigAccumulator::cos_power(*word), RealTrigAccumulator::sin_power(*word)));
+        }
+        factors.push_back(std::make_pair(factors2, term.second));
+    }
+    return factors;
+}
+
+static
+RealTrigPolynomial zero() { return RealTrigPolynomial(); }
+
+static
+RealTrigPolynomial one() { return from_terms({real_trig_term_t(TrigMonomial::one(), 1.0)}); }
+
+static
+RealTrigPolynomial cos(const TrigSymbol& symbol)
+{
+    TrigMonomial::word_t word = RealTrigAccumulator::pack(symbol.id(), 1, 0);
+    return from_terms({real_trig_term_t(TrigMonomial::from_words(&word, &word + 1), 1.0)});
+}
+
+static
+RealTrigPolynomial sin(const TrigSymbol& symbol)
+{
+    TrigMonomial::word_t word = RealTrigAccumulator::pack(symbol.id(), 0, 1);
+    return from_terms({real_trig_term_t(TrigMonomial::from_words(&word, &word + 1), 1.0)});
+}
+
+RealTrigPolynomial operator-() const
+{
+    RealTrigPolynomial poly = *this;
+    for (auto& term : poly.terms_) {
+        term.second = -term.second;
+    }
+    return poly;
+}
+
+friend RealTrigPolynomial operator+(const RealTrigPolynomial& a, const RealTrigPolynomial& b)
+{
+    static thread_local RealTrigAccumulator accumulator;
+    accumulator.add(a.terms());
+    accumulator.add(b.terms());
+    return from_terms(accumulator.terms());
+}
+
+friend RealTrigPolynomial operator-(const RealTrigPolynomial& a, const RealTrigPolynomial& b)
+{
+    return a + (-b);
+}
+
+friend RealTrigPolynomial operator*(const RealTrigPolynomial& a, const RealTrigPolynomial& b)
+{
+    static thread_local RealTrigAccumulator accumulator;
+    accumulator.add_product(a.terms(), b.terms());
+    RealTrigPolynomial product = from_terms(accumulator.terms());
+    accumulator.flush();
+    return product;
+}
+
+RealTrigPolynomial operator*(double scalar) const
+{
+    RealTrigPolynomial poly = *this;
+    for (auto& term : poly.terms_) {
+        term.second = term.second * scalar;
+    }
+    return poly;
+}
+
+friend RealTrigPolynomial operator*(double scalar, const RealTrigPolynomial& poly)
+{
+    return poly * scalar;
+}
+
+// True if poly is real for all real symbol values (to within cutoff)
+static
+bool is_real(const TrigPolynomial& poly, double cutoff=1.0E-12)
+{
+    RealTrigPolynomial result;
+    return convert(poly, cutoff, result);
+}
+
+// Rewrites poly in the real basis, dropping terms with |coefficient| <= cutoff.
+// Throws if any imaginary part exceeds cutoff.
+static
+RealTrigPolynomial from_complex(const TrigPolynomial& poly, double cutoff=1.0E-12)
+{
+    RealTrigPolynomial result;
+    if (!convert(poly, cutoff, result)) throw std::runtime_error("polynomial is not real");
+    return result;
+}
+
+// Rewrites this polynomial in the exp(1j*k*symbol) basis of TrigPolynomial
+TrigPolynomial complex() const
+{
+    TrigPolynomial poly;
+    for (auto const& term : terms_) {
+        TrigPolynomial product = TrigPolynomial::one() * std::complex<double>(term.second);
+        for (const TrigMonomial::word_t* word = term.first.begin(); word != term.first.end(); ++word) {
+            TrigSymbol symbol = TrigSymbol::from_id(TrigMonomial::symbol(*word));
+            for (int power = 0; power < RealTrigAccumulator::cos_power(*word); power++) {
+                product = product * TrigPolynomial::cos(symbol);
+            }
+            if (RealTrigAccumulator::sin_power(*word)) product = product * TrigPolynomial::sin(symbol);
+        }
+        poly += product;
+    }
+    return poly;
+}
+
+private:
+
+std::vector<real_trig_term_t> terms_;
+
+// exp(1j*k*symbol) = (cos - 1j*sign(k)*sin)^|k| per symbol (with sin as in
+// TrigPolynomial::sin, which is 0.5j*(exp(1j*symbol) - exp(-1j*symbol))), expanded binomially
+// with sin^(2m+r) = sin^r * (1 - cos^2)^m, then multiplied out across symbols
+static
+bool convert(const TrigPolynomial& poly, double cutoff, RealTrigPolynomial& result)
+{
+    BasicTrigAccumulator<std::complex<double>> accumulator;
+    std::vector<std::pair<std::vector<TrigMonomial::word_t>, std::complex<double>>> products;
+    std::vector<std::pair<std::vector<TrigMonomial::word_t>, std::complex<double>>> products2;
+    for (auto const& term : poly.terms()) {
+        products.assign(1, std::make_pair(std::vector<TrigMonomial::word_t>(), term.second));
+        for (const TrigMonomial::word_t* word = term.first.begin(); word != term.first.end(); ++word) {
+            uint32_t symbol = TrigMonomial::symbol(*word);
+            int order = TrigMonomial::order(*word);
+            int n = std::abs(order);
+            std::complex<double> isin(0.0, order > 0 ? -1.0 : 1.0);
+
+            // (cos power, sin power) -> coefficient for this symbol
+            std::map<std::pair<int, int>, std::complex<double>> expansion;
+            double binomial_nj = 1.0;
+            std::complex<double> isin_j = 1.0;
+            for (int j = 0; j <= n; j++) {
+                int m = j / 2;
+                double binomial_mt = 1.0;
+                for (int t = 0; t <= m; t++) {
+                    expansion[std::make_pair(n - j + 2 * t, j % 2)] += binomial_nj * isin_j * binomial_mt * ((t % 2) ? -1.0 : 1.0);
+                    binomial_mt = binomial_mt * (m - t) / (t + 1);
+                }
+                binomial_nj = binomial_nj * (n - j) / (j + 1);
+                isin_j *= isin;
+            }
+
+            products2.clear();
+            for (auto const& product : products) {
+                for (auto const& factor : expansion) {
+                    if (factor.second == 0.0) continue;
+                    products2.push_back(product);
+                    if (factor.first.first != 0 || factor.first.second != 0) {
+                        products2.back().first.push_back(RealTrigAccumulator::pack(symbol, factor.first.first, factor.first.second));
+                    }
+                    products2.back().second *= factor.second;
+                }
+            }
+            std::swap(products, products2);
+        }
+        for (auto const& product : products) {
+            accumulator.add(TrigMonomial::from_words(product.first.data(), product.first.data() + product.first.size()), product.second);
+        }
+    }
+
+    std::vector<real_trig_term_t> terms;
+    for (auto const& term : accumulator.terms()) {
+        if (std::abs(term.second.imag()) > cutoff) return false;
+        if (std::abs(term.second.real()) <= cutoff) continue;
+        terms.push_back(real_trig_term_t(term.first, term.second.real()));
+    }
+    result = from_terms(std::move(terms));
+    return true;
+}
+
+};
+
+class RealTrigTensor {
+
+public:
+
+typedef RealTrigPolynomial polynomial_t;
+
+RealTrigTensor() : size_(0) {}
+
+RealTrigTensor(const std::vector<size_t>& shape) :
+    shape_(shape)
+{
+    size_ = 1;
+    for (auto shape2: shape_) {
+        size_ *= shape2;
+    }
+    data_.resize(size_);
+}
+
+const std::vector<size_t>& shape() const { return shape_; }
+size_t size() const { return size_; }
+
+std::vector<RealTrigPolynomial>& data() { return data_; }
+const std::vector<RealTrigPolynomial>& data() const { return data_; }
+
+static bool is_real(const TrigTensor& tensor, double cutoff=1.0E-12)
+{
+    for (auto const& poly : tensor.data()) {
+        if (!RealTrigPolynomial::is_real(poly, cutoff)) return false;
+    }
+    return true;
+}
+
+static RealTrigTensor from_complex(const TrigTensor& tensor, double cutoff=1.0E-12)
+{
+    RealTrigTensor tensor2(tensor.shape());
+    for (size_t index = 0; index < tensor.size(); index++) {
+        tensor2.data_[index] = RealTrigPolynomial::from_complex(tensor.data()[index], cutoff);
+    }
+    return tensor2;
+}
+
+TrigTensor complex() const
+{
+    TrigTensor tensor(shape_);
+    for (size_t index = 0; index < size_; index++) {
+        tensor.data()[index] = data_[index].complex();
+    }
+    return tensor;
+}
+
+private:
+
+std::vector<size_t> shape_;
+
+size_t size_;
+
+std::vector<RealTrigPolynomial> data_;
+
+};
+
+} // namespace autogate
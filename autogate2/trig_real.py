@@ -0,0 +1,2 @@
+from .autogate_plugin import RealTrigPolynomial
+from .autogate_plugin import RealTrigTensor
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "trig_tensor.hpp"
+#include <iterator>
+
+namespace autogate {
+
+// Compressed sparse row storage of a 2-index TrigTensor. Only structurally
+// nonzero entries (polynomials with at least one term) are stored.
+class TrigSparseTensor {
+
+public:
+
+TrigSparseTensor() {}
+
+TrigSparseTensor(const std::vector<size_t>& shape) :
+    shape_(shape),
+    row_offsets_(shape.size() == 2 ? shape[0] + 1 : 0, 0)
+{
+    if (shape_.size() != 2) throw std::runtime_error("TrigSparseTensor must have 2 indices");
+}
+
+TrigSparseTensor(
+    const std::vector<size_t>& shape,
+    const std::vector<size_t>& row_offsets,
+    const std::vector<size_t>& col_indices,
+    std::vector<TrigPolynomial> data) :
+    shape_(shape),
+    row_offsets_(row_offsets),
+    col_indices_(col_indices),
+    data_(std::move(data))
+{
+    if (shape_.size() != 2) throw std::runtime_error("TrigSparseTensor must have 2 indices");
+    if (row_offsets_.size() != shape_[0] + 1 || row_offsets_.front() != 0 || row_offsets_.back() != data_.size()) throw std::runtime_error("row_offsets do not match shape and data");
+    if (col_indices_.size() != data_.size()) throw std::runtime_error("col_indices.size() != data.size()");
+    if (!std::is_sorted(row_offsets_.begin(), row_offsets_.end())) throw std::runtime_error("row_offsets must be sorted");
+    for (auto j : col_indices_) {
+        if (j >= shape_[1]) throw std::runtime_error("col_indices out of range");
+    }
+}
+
+const std::vector<size_t>& shape() const { return shape_; }
+size_t nnz() const { return data_.size(); }
+
+const std::vector<size_t>& row_offsets() const { return row_offsets_; }
+const std::vector<size_t>& col_indices() const { return col_indices_; }
+const std::vector<TrigPolynomial>& data() const { return data_; }
+
+static TrigSparseTensor from_dense(const TrigTensor& dense)
+{
+    TrigSparseTensor tensor(dense.shape());
+    const size_t nrow = tensor.shape()[0];
+    const size_t ncol = tensor.shape()[1];
+    const std::vector<TrigPolynomial>& data = dense.data();
+    for (size_t i = 0; i < nrow; i++) {
+        for (size_t j = 0; j < ncol; j++) {
+            if (data[i*ncol + j].terms().empty()) continue;
+            tensor.col_indices_.push_back(j);
+            tensor.data_.push_back(data[i*ncol + j]);
+        }
+        tensor.row_offsets_[i+1] = tensor.data_.size();
+    }
+    return tensor;
+}
+
+TrigTensor dense() const
+{
+    TrigTensor tensor(shape_);
+    const size_t ncol = shape_[1];
+    std::vector<TrigPolynomial>& data = tensor.data();
+    for (size_t i = 0; i + 1 < row_offsets_.size(); i++) {
+        for (size_t index = row_offsets_[i]; index < row_offsets_[i+1]; index++) {
+            data[i*ncol + col_indices_[index]] = data_[index];
+        }
+    }
+    return tensor;
+}
+
+static TrigTensor gemm(const TrigSparseTensor& a, const TrigTensor& b)
+{
+    if (b.shape().size() != 2 || a.shape()[1] != b.shape()[0]) throw std::runtime_error("Tensors are not conformal");
+
+    TrigTensor tensor(std::vector<size_t>{a.shape()[0], b.shape()[1]});
+    std::vector<TrigPolynomial>& data = tensor.data();
+    const std::vector<TrigPolynomial>& bdata = b.data();
+    const size_t nrow = a.shape()[0];
+    const size_t ncol = b.shape()[1];
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel num_threads(Parallel::num_threads())
+    {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        TrigAccumulator accumulator;
+        #pragma omp for schedule(dynamic)
+        for (ssize_t i = 0; i < (ssize_t) nrow; i++) {
+            for (size_t j = 0; j < ncol; j++) {
+                for (size_t index = a.row_offsets_[i]; index < a.row_offsets_[i+1]; index++) {
+                    accumulator.add_product(a.data_[index].terms(), bdata[a.col_indices_[index]*ncol + j].terms());
+                }
+                data[i*ncol + j] = TrigPolynomial::from_terms(accumulator.terms());
+            }
+        }
+    }
+    return tensor;
+}
+
+static TrigTensor gemm(const TrigTensor& a, const TrigSparseTensor& b)
+{
+    if (a.shape().size() != 2 || a.shape()[1] != b.shape()[0]) throw std::runtime_error("Tensors are not conformal");
+
+    // Column-major view of b so that each output entry walks one column
+    const TrigSparseTensor bt = b.transpose();
+    TrigTensor tensor(std::vector<size_t>{a.shape()[0], b.shape()[1]});
+    std::vector<TrigPolynomial>& data = tensor.data();
+    const std::vector<TrigPolynomial>& adata = a.data();
+    const size_t nrow = a.shape()[0];
+    const size_t nk = a.shape()[1];
+    const size_t ncol = b.shape()[1];
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel num_threads(Parallel::num_threads())
+    {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        TrigAccumulator accumulator;
+        #pragma omp for schedule(dynamic)
+        for (ssize_t i = 0; i < (ssize_t) nrow; i++) {
+            for (size_t j = 0; j < ncol; j++) {
+                for (size_t index = bt.row_offsets_[j]; index < bt.row_offsets_[j+1]; index++) {
+                    accumulator.add_product(adata[i*nk + bt.col_indices_[index]].terms(), bt.data_[index].terms());
+                }
+                data[i*ncol + j] = TrigPolynomial::from_terms(accumulator.terms());
+            }
+        }
+    }
+    return tensor;
+}
+
+static TrigSparseTensor gemm(const TrigSparseTensor& a, const TrigSparseTensor& b)
+{
+    if (a.shape()[1] != b.shape()[0]) throw std::runtime_error("Tensors are not conformal");
+
+    const size_t nrow = a.shape()[0];
+    std::vector<std::vector<size_t>> row_cols(nrow);
+    std::vector<std::vector<TrigPolynomial>> row_data(nrow);
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel num_threads(Parallel::num_threads())
+    {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        TrigAccumulator accumulator;
+        // (column of the output, a entry, b entry) contributions to one output row
+        std::vector<std::pair<size_t, std::pair<size_t, size_t>>> contributions;
+        #pragma omp for schedule(dynamic)
+        for (ssize_t i = 0; i < (ssize_t) nrow; i++) {
+            contributions.clear();
+            for (size_t indexa = a.row_offsets_[i]; indexa < a.row_offsets_[i+1]; indexa++) {
+                size_t k = a.col_indices_[indexa];
+                for (size_t indexb = b.row_offsets_[k]; indexb < b.row_offsets_[k+1]; indexb++) {
+                    contributions.push_back(std::make_pair(b.col_indices_[indexb], std::make_pair(indexa, indexb)));
+                }
+            }
+            std::sort(contributions.begin(), contributions.end());
+            for (size_t start = 0; start < contributions.size(); ) {
+                size_t j = contributions[start].first;
+                size_t stop = start;
+                for (; stop < contributions.size() && contributions[stop].first == j; stop++) {
+                    accumulator.add_product(a.data_[contributions[stop].second.first].terms(), b.data_[contributions[stop].second.second].terms());
+                }
+                TrigPolynomial value = TrigPolynomial::from_terms(accumulator.terms());
+                if (!value.terms().empty()) {
+                    row_cols[i].push_back(j);
+                    row_data[i].push_back(std::move(value));
+                }
+                start = stop;
+            }
+        }
+    }
+
+    TrigSparseTensor tensor(std::vector<size_t>{nrow, b.shape()[1]});
+    for (size_t i = 0; i < nrow; i++) {
+        tensor.col_indices_.insert(tensor.col_indices_.end(), row_cols[i].begin(), row_cols[i].end());
+        std::move(row_data[i].begin(), row_data[i].end(), std::back_inserter(tensor.data_));
+        tensor.row_offsets_[i+1] = tensor.data_.size();
+    }
+    return tensor;
+}
+
+TrigSparseTensor transpose() const
+{
+    TrigSparseTensor tensor(std::vector<size_t>{shape_[1], shape_[0]});
+    std::vector<size_t>& offsets = tensor.row_offsets_;
+    for (auto j : col_indices_) {
+        offsets[j+1]++;
+    }
+    for (size_t j = 0; j < shape_[1]; j++) {
+        offsets[j+1] += offsets[j];
+    }
+    tensor.col_indices_.resize(nnz());
+    tensor.data_.resize(nnz());
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < shape_[0]; i++) {
+        for (size_t index = row_offsets_[i]; index < row_offsets_[i+1]; index++) {
+            size_t target = next[col_indices_[index]]++;
+            tensor.col_indices_[target] = i;
+            tensor.data_[target] = data_[index];
+        }
+    }
+    return tensor;
+}
+
+private:
+
+std::vector<size_t> shape_;
+std::vector<size_t> row_offsets_;
+std::vector<size_t> col_indices_;
+std::vector<TrigPolynomial> data_;
+
+};
+
+} // namespace autogate
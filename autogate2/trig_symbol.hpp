@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace autogate {
+
+// Process-wide table of parameter names. Single-character names keep their
+// character code as id (so 'a' is 97, as before symbol names existed), and every
+// longer name is assigned the next dense id from first_id upward the first time
+// it is seen. Integer names are the same as their decimal strings.
+class TrigSymbolTable {
+
+public:
+
+static const uint32_t first_id = 256;
+
+static uint32_t id(const std::string& name)
+{
+    if (name.empty()) throw std::runtime_error("Symbol names must not be empty");
+    if (name.size() == 1) return (unsigned char) name[0];
+
+    TrigSymbolTable& table = instance();
+    std::lock_guard<std::mutex> lock(table.mutex_);
+    auto it = table.ids_.find(name);
+    if (it != table.ids_.end()) return it->second;
+    uint32_t id = first_id + table.names_.size();
+    table.ids_[name] = id;
+    table.names_.push_back(name);
+    return id;
+}
+
+static std::string name(uint32_t id)
+{
+    if (id < first_id) return std::string(1, (char) id);
+
+    TrigSymbolTable& table = instance();
+    std::lock_guard<std::mutex> lock(table.mutex_);
+    if (id - first_id >= table.names_.size()) throw std::runtime_error("Unknown symbol id");
+    return table.names_[id - first_id];
+}
+
+// Number of multi-character names registered so far
+static size_t size()
+{
+    TrigSymbolTable& table = instance();
+    std::lock_guard<std::mutex> lock(table.mutex_);
+    return table.names_.size();
+}
+
+private:
+
+std::mutex mutex_;
+std::map<std::string, uint32_t> ids_;
+std::vector<std::string> names_;
+
+static TrigSymbolTable& instance() { static TrigSymbolTable table; return table; }
+
+};
+
+// A parameter, identified by its dense TrigSymbolTable id. Converts implicitly
+// from a char, a name, or an integer name, so the char-based API is unchanged.
+class TrigSymbol {
+
+public:
+
+TrigSymbol() : id_(0) {}
+TrigSymbol(char symbol) : id_((unsigned char) symbol) {}
+TrigSymbol(const char* name) : id_(TrigSymbolTable::id(name)) {}
+TrigSymbol(const std::string& name) : id_(TrigSymbolTable::id(name)) {}
+TrigSymbol(int name) : id_(TrigSymbolTable::id(std::to_string(name))) {}
+
+static TrigSymbol from_id(uint32_t id) { TrigSymbol symbol; symbol.id_ = id; return symbol; }
+
+uint32_t id() const { return id_; }
+std::string name() const { return TrigSymbolTable::name(id_); }
+
+friend bool operator==(const TrigSymbol& a, const TrigSymbol& b) { return a.id_ == b.id_; }
+friend bool operator!=(const TrigSymbol& a, const TrigSymbol& b) { return a.id_ != b.id_; }
+friend bool operator<(const TrigSymbol& a, const TrigSymbol& b) { return a.id_ < b.id_; }
+
+private:
+
+uint32_t id_;
+
+};
+
+} // namespace autogate
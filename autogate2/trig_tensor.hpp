@@ -1,12 +1,18 @@
 #pragma once
 
+#include "trig.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
 namespace autogate {
 
 class TrigTensor {
 
 public:
 
-TrigTensor() {}
+typedef TrigPolynomial polynomial_t;
+
+TrigTensor() : size_(0) {}
 
 TrigTensor(const std::vector<size_t>& shape) :
     shape_(shape)
@@ -23,6 +29,18 @@ const size_t size() const { return size_; }
 
 std::vector<TrigPolynomial>& data() { return data_; }
 const std::vector<TrigPolynomial>& data() const { return data_; }
+
+// Row-major offset into data() of the entry at indices
+size_t offset(const std::vector<size_t>& indices) const
+{
+    if (indices.size() != shape_.size()) throw std::runtime_error("indices.size() != shape.size()");
+    size_t offset = 0;
+    for (size_t dim = 0; dim < shape_.size(); dim++) {
+        if (indices[dim] >= shape_[dim]) throw std::runtime_error("index out of range");
+        offset = offset * shape_[dim] + indices[dim];
+    }
+    return offset;
+}
 // TODO vector of strides
     
 TrigTensor operator+() const
@@ -168,21 +186,88 @@ static TrigTensor gemm(const TrigTensor& a, const TrigTensor& b)
 {
     if (a.shape() != b.shape()) throw std::runtime_error("Tensors are not the same shape");
 
+    std::unique_ptr<Profiler::Span> span(Profiler::enabled() ? new Profiler::Span("gemm") : nullptr);
     TrigTensor tensor(a.shape());
     std::vector<TrigPolynomial>& data = tensor.data();
     const std::vector<TrigPolynomial>& adata = a.data();
     const std::vector<TrigPolynomial>& bdata = b.data();
     const size_t dim = tensor.shape()[0];
+
+    // Structurally nonzero k indices of each row of a and each column of b, so
+    // that only the k shared by both contribute to an output entry
+    std::vector<std::vector<size_t>> arows(dim);
+    std::vector<std::vector<size_t>> bcols(dim);
     for (size_t i = 0; i < dim; i++) {
-        for (size_t j = 0; j < dim; j++) {
-            for (size_t k = 0; k < dim; k++) {
-                data[(i*dim) + j] += adata[(i*dim) + k] * bdata[j + (k*dim)]; 
+        for (size_t k = 0; k < dim; k++) {
+            if (!adata[(i*dim) + k].terms().empty()) arows[i].push_back(k);
+            if (!bdata[(k*dim) + i].terms().empty()) bcols[i].push_back(k);
+        }
+    }
+
+    TrigSieve::Scope* sieve = TrigSieve::current();
+    #pragma omp parallel num_threads(Parallel::num_threads())
+    {
+        TrigArena::Scope arena_scope;
+        TrigSieve::Scope sieve_scope(sieve);
+        TrigAccumulator accumulator;
+        #pragma omp for schedule(dynamic)
+        for (ssize_t i = 0; i < (ssize_t) dim; i++) {
+            for (size_t j = 0; j < dim; j++) {
+                auto itera = arows[i].begin();
+                auto iterb = bcols[j].begin();
+                while (itera != arows[i].end() && iterb != bcols[j].end()) {
+                    if (*itera < *iterb) {
+                        ++itera;
+                    } else if (*iterb < *itera) {
+                        ++iterb;
+                    } else {
+                        accumulator.add_product(adata[(i*dim) + *itera].terms(), bdata[j + (*iterb*dim)].terms()); 
+                        ++itera;
+                        ++iterb;
+                    }
+                }
+                data[(i*dim) + j] = TrigPolynomial::from_terms(accumulator.terms());
             }
         }
     }
+    if (span) span->finish(data);
     return tensor;
 }
  
+TrigTensor derivative(const TrigSymbol& symbol) const
+{
+    TrigTensor tensor(shape_);
+    std::vector<TrigPolynomial>& data = tensor.data();
+    for (size_t index = 0; index < data.size(); index++) {
+        data[index] = data_[index].derivative(symbol);
+    }
+    return tensor;
+}
+
+// [d/dsymbols[s]] for each s
+std::vector<TrigTensor> jacobian(const std::vector<TrigSymbol>& symbols) const
+{
+    std::vector<TrigTensor> tensors;
+    for (auto symbol : symbols) {
+        tensors.push_back(derivative(symbol));
+    }
+    return tensors;
+}
+
+// [[d^2/dsymbols[s]dsymbols[t]]] for each s, t (symmetric, each pair formed once)
+std::vector<std::vector<TrigTensor>> hessian(const std::vector<TrigSymbol>& symbols) const
+{
+    std::vector<TrigTensor> jac = jacobian(symbols);
+    std::vector<std::vector<TrigTensor>> tensors(symbols.size(), std::vector<TrigTensor>(symbols.size()));
+    for (size_t s = 0; s < symbols.size(); s++) {
+        for (size_t t = 0; t <= s; t++) {
+            tensors[s][t] = jac[s].derivative(symbols[t]);
+            if (t != s) tensors[t][s] = tensors[s][t];
+        }
+    }
+    return tensors;
+}
+
 TrigTensor& operator*=(const std::complex<double>& scalar);
 TrigTensor& operator/=(const std::complex<double>& scalar);
     